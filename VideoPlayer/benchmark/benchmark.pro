@@ -0,0 +1,58 @@
+QT = core gui multimedia network
+
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+TARGET = VideoPlayerBenchmark
+
+PLAYER_PATH = $$PWD/../src/player
+
+INCLUDEPATH += $$PWD $$PLAYER_PATH
+DEPENDPATH += $$PWD $$PLAYER_PATH
+
+# Only the decoder part of the player, no Qt Quick
+HEADERS += \
+   $$PWD/httpserver.h \
+   $$PWD/testmedia.h \
+   $$PLAYER_PATH/config.h \
+   $$PLAYER_PATH/decodeworker.h \
+   $$PLAYER_PATH/ffmpeg.h \
+   $$PLAYER_PATH/ffmpegdecoder.h \
+   $$PLAYER_PATH/framepool.h \
+   $$PLAYER_PATH/framequeue.h \
+   $$PLAYER_PATH/keyframeindex.h \
+   $$PLAYER_PATH/mappedfileio.h \
+   $$PLAYER_PATH/networkinput.h \
+   $$PLAYER_PATH/packetqueue.h \
+   $$PLAYER_PATH/playerconfig.h \
+   $$PLAYER_PATH/rangecache.h \
+   $$PLAYER_PATH/tracer.h
+
+SOURCES += \
+   $$PWD/main.cpp \
+   $$PWD/httpserver.cpp \
+   $$PWD/testmedia.cpp \
+   $$PLAYER_PATH/decodeworker.cpp \
+   $$PLAYER_PATH/ffmpegdecoder.cpp \
+   $$PLAYER_PATH/framepool.cpp \
+   $$PLAYER_PATH/keyframeindex.cpp \
+   $$PLAYER_PATH/mappedfileio.cpp \
+   $$PLAYER_PATH/networkinput.cpp \
+   $$PLAYER_PATH/packetqueue.cpp \
+   $$PLAYER_PATH/playerconfig.cpp \
+   $$PLAYER_PATH/rangecache.cpp \
+   $$PLAYER_PATH/tracer.cpp
+
+win32 {
+    # FFmpeg
+    LIBS += -L$$(FFMPEG_PATH)/lib/ -lavutil -lavcodec -lavformat -lavfilter -lswresample -lswscale
+    INCLUDEPATH += $$(FFMPEG_PATH)/include
+    DEPENDPATH += $$(FFMPEG_PATH)/include
+}
+
+unix {
+    # FFmpeg
+    LIBS += -L/usr/lib64/ -lavutil -lavcodec -lavformat -lavfilter -lswresample -lswscale
+    INCLUDEPATH += /usr/include/ffmpeg
+    DEPENDPATH += /usr/include/ffmpeg
+}
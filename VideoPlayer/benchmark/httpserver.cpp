@@ -0,0 +1,184 @@
+/**
+ * @brief HTTP Server
+ * @anchor Ho 229
+ * @date 2023/5/24
+ */
+
+#include "httpserver.h"
+
+#include <QFile>
+#include <QTimer>
+#include <QFileInfo>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QRegularExpression>
+
+// The response is written every HTTP_TICK, in milliseconds
+#define HTTP_TICK 10
+
+// The socket is not written while more than HTTP_CHUNK is pending, in bytes
+#define HTTP_CHUNK (256 * 1024)
+
+/**
+ * @brief A response of a single request, the connection is closed after it
+ */
+class HttpConnection : public QObject
+{
+public:
+    HttpConnection(QTcpSocket *socket, const HttpServer *server);
+
+private:
+    void readRequest();
+    void writeBody();
+
+    void respond(const QByteArray &status, const QList<QByteArray> &headers);
+
+    QTcpSocket *const m_socket;
+    const HttpServer *const m_server;
+
+    QFile m_file;
+    QByteArray m_request;
+    qint64 m_remaining = 0;
+
+    QTimer m_timer;
+};
+
+HttpConnection::HttpConnection(QTcpSocket *socket, const HttpServer *server) :
+    QObject(socket),
+    m_socket(socket),
+    m_server(server),
+    m_file(server->fileName())
+{
+    QObject::connect(socket, &QTcpSocket::readyRead, this, &HttpConnection::readRequest);
+    QObject::connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+
+    QObject::connect(&m_timer, &QTimer::timeout, this, &HttpConnection::writeBody);
+    m_timer.setInterval(HTTP_TICK);
+}
+
+void HttpConnection::readRequest()
+{
+    if(m_timer.isActive())
+        return;
+
+    m_request += m_socket->readAll();
+    if(!m_request.contains("\r\n\r\n"))
+        return;
+
+    if(!m_request.startsWith("GET ") && !m_request.startsWith("HEAD "))
+    {
+        this->respond("405 Method Not Allowed", {});
+        return;
+    }
+
+    if(!m_file.open(QIODevice::ReadOnly))
+    {
+        this->respond("404 Not Found", {});
+        return;
+    }
+
+    const qint64 size = m_file.size();
+    qint64 first = 0, last = size - 1;
+
+    static const QRegularExpression rangeExpression("\r\nRange: *bytes=(\\d+)-(\\d*)",
+                                                    QRegularExpression::CaseInsensitiveOption);
+    const QRegularExpressionMatch range = rangeExpression.match(m_request);
+
+    if(range.hasMatch())
+    {
+        first = range.captured(1).toLongLong();
+        if(!range.captured(2).isEmpty())
+            last = qMin(last, range.captured(2).toLongLong());
+
+        if(first >= size || first > last)
+        {
+            this->respond("416 Range Not Satisfiable", { "Content-Range: bytes */" + QByteArray::number(size) });
+            return;
+        }
+    }
+
+    m_file.seek(first);
+    m_remaining = m_request.startsWith("HEAD ") ? 0 : last - first + 1;
+
+    QList<QByteArray> headers = {
+        "Content-Type: application/octet-stream",
+        "Accept-Ranges: bytes",
+        "Content-Length: " + QByteArray::number(last - first + 1)
+    };
+
+    if(range.hasMatch())
+        headers.append("Content-Range: bytes " + QByteArray::number(first) + '-' +
+                       QByteArray::number(last) + '/' + QByteArray::number(size));
+
+    this->respond(range.hasMatch() ? "206 Partial Content" : "200 OK", headers);
+}
+
+void HttpConnection::writeBody()
+{
+    if(m_remaining <= 0)
+    {
+        m_timer.stop();
+        m_socket->disconnectFromHost();
+        return;
+    }
+
+    if(m_server->isStalled() || m_socket->bytesToWrite() > HTTP_CHUNK)
+        return;
+
+    const qint64 budget = m_server->rate > 0 ? qMax<qint64>(1, m_server->rate * HTTP_TICK / 1000) : HTTP_CHUNK;
+    const QByteArray data = m_file.read(qMin(budget, m_remaining));
+
+    if(data.isEmpty())
+        m_remaining = 0;
+    else
+    {
+        m_socket->write(data);
+        m_remaining -= data.size();
+    }
+}
+
+void HttpConnection::respond(const QByteArray &status, const QList<QByteArray> &headers)
+{
+    QByteArray response = "HTTP/1.1 " + status + "\r\n";
+    for(const QByteArray &header : headers)
+        response += header + "\r\n";
+
+    // A new connection for every request, eg. after a seek
+    response += "Connection: close\r\n\r\n";
+
+    m_socket->write(response);
+    m_timer.start();
+}
+
+HttpServer::HttpServer(const QString &fileName, QObject *parent) :
+    QObject(parent),
+    m_fileName(fileName)
+{
+
+}
+
+bool HttpServer::listen()
+{
+    m_server = new QTcpServer(this);
+    if(!m_server->listen(QHostAddress::LocalHost))
+        return false;
+
+    QObject::connect(m_server, &QTcpServer::newConnection, this, [this] {
+        while(QTcpSocket *socket = m_server->nextPendingConnection())
+            new HttpConnection(socket, this);
+    });
+
+    m_url.setScheme("http");
+    m_url.setHost("127.0.0.1");
+    m_url.setPort(m_server->serverPort());
+    m_url.setPath('/' + QFileInfo(m_fileName).fileName());
+
+    m_clock.start();
+
+    return true;
+}
+
+bool HttpServer::isStalled() const
+{
+    return stallDuration > 0 && stallInterval > 0 && m_clock.elapsed() % stallInterval < stallDuration;
+}
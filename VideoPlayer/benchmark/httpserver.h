@@ -0,0 +1,59 @@
+/**
+ * @brief HTTP Server
+ * @anchor Ho 229
+ * @date 2023/5/24
+ */
+
+#ifndef HTTPSERVER_H
+#define HTTPSERVER_H
+
+#include <QUrl>
+#include <QObject>
+#include <QElapsedTimer>
+
+class QTcpServer;
+
+/**
+ * @brief Stand-in of a media server on the loopback, it serves one file with the range
+ *        requests and is throttled and stalled on demand, so the network input is
+ *        measured without a network
+ * @note Set the members before HttpServer::listen(), the connections are served
+ *       on the thread it lives in
+ */
+class HttpServer : public QObject
+{
+    Q_OBJECT
+public:
+    explicit HttpServer(const QString &fileName, QObject *parent = nullptr);
+
+    qint64 rate = 0;                // in bytes per second, 0 means unlimited
+
+    // Nothing is sent for stallDuration every stallInterval, in milliseconds, 0 means no stall
+    int stallDuration = 0;
+    int stallInterval = 0;
+
+    /**
+     * @brief Listen on a free port of the loopback
+     */
+    Q_INVOKABLE bool listen();
+
+    /**
+     * @return URL of the file, valid after HttpServer::listen()
+     */
+    QUrl url() const { return m_url; }
+
+    QString fileName() const { return m_fileName; }
+
+    /**
+     * @return true if nothing is sent now
+     */
+    bool isStalled() const;
+
+private:
+    QTcpServer *m_server = nullptr;
+    QString m_fileName;
+    QUrl m_url;
+    QElapsedTimer m_clock;          // Of the stalls
+};
+
+#endif // HTTPSERVER_H
@@ -0,0 +1,387 @@
+/**
+ * @brief Decoder Benchmark
+ * @anchor Ho 229
+ * @date 2023/5/21
+ */
+
+#include "testmedia.h"
+#include "httpserver.h"
+#include "networkinput.h"
+#include "playerconfig.h"
+#include "ffmpegdecoder.h"
+
+#include <QDir>
+#include <QFile>
+#include <QThread>
+#include <QEventLoop>
+#include <QMetaEnum>
+#include <QJsonObject>
+#include <QTextStream>
+#include <QJsonDocument>
+#include <QElapsedTimer>
+#include <QTemporaryDir>
+#include <QScopeGuard>
+#include <QRandomGenerator>
+#include <QCoreApplication>
+#include <QCommandLineParser>
+
+#include <numeric>
+#include <algorithm>
+
+// Sleep of the frame loops while the caches are empty, in microseconds
+#define POLL_INTERVAL 100
+
+// Seed of the seek positions, the same ones on every run
+#define SEEK_SEED 229
+
+/**
+ * @param samples in milliseconds
+ */
+static QJsonObject distribution(QVector<qreal> samples)
+{
+    if(samples.isEmpty())
+        return {};
+
+    std::sort(samples.begin(), samples.end());
+
+    auto percentile = [&samples](qreal p) {
+        return samples[qMin(int(p * samples.size()), samples.size() - 1)];
+    };
+
+    return {
+        { "mean", std::accumulate(samples.cbegin(), samples.cend(), 0.) / samples.size() },
+        { "p50", percentile(0.5) },
+        { "p90", percentile(0.9) },
+        { "p99", percentile(0.99) },
+        { "max", samples.last() }
+    };
+}
+
+static bool hasVideo(const FFmpegDecoder *decoder)
+{
+    return !qIsNaN(decoder->fps());
+}
+
+/**
+ * @brief Pull the frames as fast as possible until the end, the audio is drained only
+ */
+static QJsonObject benchmarkDecode(FFmpegDecoder *decoder)
+{
+    QVector<qreal> frameTimes;
+    qreal firstFrameTime = -1;
+    int videoFrames = 0, audioFrames = 0;
+    qint64 peakResidentBytes = 0;
+
+    QElapsedTimer timer, frameTimer;
+    timer.start();
+    frameTimer.start();
+
+    forever
+    {
+        peakResidentBytes = qMax(peakResidentBytes, decoder->residentBytes());
+
+        bool isTaken = false;
+        if(AVFrame *frame = decoder->takeVideoFrame())
+        {
+            const qreal time = frameTimer.nsecsElapsed() / 1e6;
+            frameTimer.restart();
+
+            // It includes the opening of the codecs
+            if(firstFrameTime < 0)
+                firstFrameTime = time;
+            else
+                frameTimes.append(time);
+
+            decoder->framePool()->recycle(frame);
+            ++videoFrames;
+            isTaken = true;
+        }
+
+        while(AVFrame *frame = decoder->takeAudioFrame())
+        {
+            decoder->framePool()->recycle(frame);
+            ++audioFrames;
+            isTaken = true;
+        }
+
+        if(isTaken)
+            continue;
+        else if(decoder->isEnd() && !decoder->hasFrame())
+            break;
+
+        QThread::usleep(POLL_INTERVAL);
+    }
+
+    const qreal seconds = timer.nsecsElapsed() / 1e9;
+    const qreal scaleTime = decoder->scaleTime() / 1e6;
+    const qreal resampleTime = decoder->resampleTime() / 1e6;
+
+    return {
+        { "seconds", seconds },
+        { "videoFrames", videoFrames },
+        { "audioFrames", audioFrames },
+        { "skippedFrames", decoder->skippedFrames() },
+        { "fps", videoFrames / seconds },
+        { "firstFrameMs", firstFrameTime },
+        { "msPerFrame", distribution(frameTimes) },
+        { "conversion", QJsonObject {
+              { "swsMs", scaleTime },
+              { "swsMsPerFrame", videoFrames ? scaleTime / videoFrames : 0 },
+              { "swrMs", resampleTime },
+              { "swrMsPerFrame", audioFrames ? resampleTime / audioFrames : 0 } } },
+        { "peakResidentBytes", peakResidentBytes },
+        { "networkUnderruns", decoder->networkInput()->isOpen() ? decoder->networkInput()->underruns() : 0 },
+        { "networkCachedBytes", decoder->networkInput()->isOpen() ? decoder->networkInput()->cachedBytes() : 0 }
+    };
+}
+
+/**
+ * @brief Seek to the random positions, the latency is until the first frame after the seek
+ */
+static QJsonObject benchmarkSeek(FFmpegDecoder *decoder, int count, bool isAccurate)
+{
+    QVector<qreal> latencies;
+    QRandomGenerator random(SEEK_SEED);
+
+    for(int i = 0; i < count && decoder->duration() > 0; ++i)
+    {
+        const int position = random.bounded(decoder->duration());
+
+        QElapsedTimer timer;
+        timer.start();
+
+        // The caches are cleared before FFmpegDecoder::seeked()
+        QEventLoop loop;
+        QObject::connect(decoder, &FFmpegDecoder::seeked, &loop, &QEventLoop::quit);
+        decoder->requestSeek(position, isAccurate);
+        loop.exec();
+
+        AVFrame *frame = nullptr;
+        while(!(frame = hasVideo(decoder) ? decoder->takeVideoFrame() : decoder->takeAudioFrame()) &&
+              !decoder->isEnd())
+            QThread::usleep(POLL_INTERVAL);
+
+        latencies.append(timer.nsecsElapsed() / 1e6);
+
+        if(frame)
+            decoder->framePool()->recycle(frame);
+    }
+
+    return {
+        { "count", latencies.size() },
+        { "accurate", isAccurate },
+        { "ms", distribution(latencies) }
+    };
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    app.setApplicationName("VideoPlayerBenchmark");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Decode throughput benchmark of FFmpegDecoder, "
+                                     "the result is written as JSON.");
+    parser.addHelpOption();
+    parser.addPositionalArgument("input", "Media file to decode, a test pattern is synthesized if omitted.",
+                                 "[input]");
+
+    const QCommandLineOption sizeOption("size", "Size of the synthesized video.", "WxH", "1920x1080");
+    const QCommandLineOption fpsOption("fps", "Frame rate of the synthesized video.", "fps", "30");
+    const QCommandLineOption durationOption("duration", "Duration of the synthesized media.", "seconds", "20");
+    const QCommandLineOption encoderOption("encoder", "Encoder of the synthesized video, "
+                                           "libx264 if available otherwise mpeg4.", "name");
+    const QCommandLineOption seeksOption("seeks", "Count of the seeks of each mode.", "count", "20");
+    const QCommandLineOption configOption("config", "INI file of PlayerConfig, "
+                                          "the VIDEOPLAYER_* variables are read too.", "file");
+    const QCommandLineOption outputOption({"o", "output"}, "Write the JSON to the file "
+                                          "instead of the standard output.", "file");
+    const QCommandLineOption httpOption("http", "Decode the media through a local HTTP server.");
+    const QCommandLineOption httpRateOption("http-rate", "Throughput of the HTTP server, unlimited if 0.",
+                                            "bytes/s", "0");
+    const QCommandLineOption httpStallOption("http-stall", "The HTTP server sends nothing for the first "
+                                             "milliseconds of every interval.", "ms/interval", "0/0");
+    parser.addOptions({ sizeOption, fpsOption, durationOption, encoderOption,
+                        seeksOption, configOption, outputOption,
+                        httpOption, httpRateOption, httpStallOption });
+
+    parser.process(app);
+
+    auto exitWithError = [](const QString &error) {
+        QTextStream(stderr) << error << Qt::endl;
+        return 1;
+    };
+
+    // Media
+    QJsonObject media;
+    QString fileName;
+    QTemporaryDir tempDir;
+
+    if(!parser.positionalArguments().isEmpty())
+        fileName = parser.positionalArguments().first();
+    else
+    {
+        TestMedia testMedia;
+
+        const QStringList size = parser.value(sizeOption).split('x');
+        if(size.size() != 2)
+            return exitWithError("Invalid size: " + parser.value(sizeOption));
+
+        testMedia.size = QSize(size[0].toInt(), size[1].toInt());
+        testMedia.fps = parser.value(fpsOption).toInt();
+        testMedia.duration = parser.value(durationOption).toInt();
+        testMedia.gopSize = testMedia.fps * 2;
+        testMedia.videoEncoder = parser.value(encoderOption);
+
+        if(testMedia.size.isEmpty() || testMedia.fps <= 0 || testMedia.duration <= 0)
+            return exitWithError("Invalid test media format");
+
+        if(!tempDir.isValid())
+            return exitWithError("Failed to create the temporary directory");
+
+        fileName = tempDir.filePath("testsrc.mkv");
+
+        QElapsedTimer timer;
+        timer.start();
+
+        if(!testMedia.write(fileName))
+            return exitWithError(testMedia.errorString());
+
+        media.insert("encoder", testMedia.usedVideoEncoder());
+        media.insert("width", testMedia.size.width());
+        media.insert("height", testMedia.size.height());
+        media.insert("synthesisSeconds", timer.nsecsElapsed() / 1e9);
+    }
+
+    media.insert("file", fileName);
+
+    QUrl url = QUrl::fromUserInput(fileName, QDir::currentPath(), QUrl::AssumeLocalFile);
+
+    // Serve it on its own thread, the benchmark loops do not run the event loop
+    QThread serverThread;
+    if(parser.isSet(httpOption))
+    {
+        const QStringList stall = parser.value(httpStallOption).split('/');
+        if(stall.size() != 2)
+            return exitWithError("Invalid stall: " + parser.value(httpStallOption));
+
+        HttpServer *server = new HttpServer(url.toLocalFile());
+        server->rate = parser.value(httpRateOption).toLongLong();
+        server->stallDuration = stall[0].toInt();
+        server->stallInterval = stall[1].toInt();
+
+        server->moveToThread(&serverThread);
+        QObject::connect(&serverThread, &QThread::finished, server, &QObject::deleteLater);
+        serverThread.start();
+
+        bool isListening = false;
+        QMetaObject::invokeMethod(server, &HttpServer::listen, Qt::BlockingQueuedConnection, &isListening);
+        if(!isListening)
+        {
+            serverThread.quit();
+            serverThread.wait();
+
+            return exitWithError("Failed to start the HTTP server");
+        }
+
+        url = server->url();
+        media.insert("http", QJsonObject {
+            { "url", url.toString() },
+            { "rate", server->rate },
+            { "stallDuration", server->stallDuration },
+            { "stallInterval", server->stallInterval } });
+    }
+
+    // Stop the server after the decoder
+    auto stopServer = qScopeGuard([&serverThread] {
+        serverThread.quit();
+        serverThread.wait();
+    });
+
+    PlayerConfig config;
+    if(parser.isSet(configOption) && !config.loadFile(parser.value(configOption)))
+        return exitWithError("Failed to read " + parser.value(configOption));
+    config.loadEnvironment();
+
+    // Same as VideoPlayer, the decoder runs on its own thread
+    QThread thread;
+    FFmpegDecoder *decoder = new FFmpegDecoder;
+    decoder->moveToThread(&thread);
+    thread.start();
+
+    decoder->setConfig(&config);
+    decoder->setUrl(url);
+
+    // Returns the state the slot ends in, FFmpegDecoder::load() passes through Loading
+    auto invoke = [decoder](void (FFmpegDecoder::*slot)()) {
+        QEventLoop loop;
+        QObject::connect(decoder, &FFmpegDecoder::stateChanged, &loop, [&loop](FFmpegDecoder::State state) {
+            if(state != FFmpegDecoder::Loading)
+                loop.exit(state);
+        });
+        QMetaObject::invokeMethod(decoder, slot, Qt::QueuedConnection);
+        return loop.exec();
+    };
+
+    QElapsedTimer loadTimer;
+    loadTimer.start();
+
+    // Measured on the decoder thread, the tracks are found before the probing if there is a header
+    qint64 tracksTime = 0;
+    QObject::connect(decoder, &FFmpegDecoder::tracksFound, decoder,
+                     [&tracksTime, &loadTimer] { tracksTime = loadTimer.nsecsElapsed(); }, Qt::DirectConnection);
+
+    if(invoke(&FFmpegDecoder::load) != FFmpegDecoder::Opened)
+    {
+        const QString error = decoder->errorString();
+
+        thread.quit();
+        thread.wait();
+        delete decoder;
+
+        return exitWithError("Failed to load " + fileName + ": " + error);
+    }
+
+    media.insert("loadMs", loadTimer.nsecsElapsed() / 1e6);
+    media.insert("tracksMs", tracksTime / 1e6);
+    media.insert("duration", decoder->duration());
+    media.insert("fps", hasVideo(decoder) ? decoder->fps() : 0);
+    media.insert("hasAudio", decoder->activeAudioTrack() >= 0);
+
+    QJsonObject result;
+    result.insert("media", media);
+    result.insert("config", QJsonObject {
+        { "threadingMode", QMetaEnum::fromType<FFmpegDecoder::ThreadingMode>().valueToKey(
+                                decoder->activeThreadingMode()) },
+        { "cacheBudget", decoder->cacheBudget() },
+        { "lookAhead", decoder->lookAhead() } });
+
+    result.insert("decode", benchmarkDecode(decoder));
+
+    const int seekCount = parser.value(seeksOption).toInt();
+    result.insert("seek", QJsonObject {
+        { "accurate", benchmarkSeek(decoder, seekCount, true) },
+        { "keyFrame", benchmarkSeek(decoder, seekCount, false) } });
+
+    decoder->requestInterrupt();
+    invoke(&FFmpegDecoder::release);
+    decoder->clearFrames();
+
+    thread.quit();
+    thread.wait();
+    delete decoder;
+
+    const QByteArray json = QJsonDocument(result).toJson();
+
+    if(!parser.isSet(outputOption))
+    {
+        QTextStream(stdout) << json;
+        return 0;
+    }
+
+    QFile file(parser.value(outputOption));
+    if(!file.open(QIODevice::WriteOnly) || file.write(json) != json.size())
+        return exitWithError("Failed to write " + file.fileName());
+
+    return 0;
+}
@@ -0,0 +1,236 @@
+/**
+ * @brief Test Media
+ * @anchor Ho 229
+ * @date 2023/5/21
+ */
+
+#include "testmedia.h"
+
+#include <ffmpeg.h>
+
+#include <QScopeGuard>
+
+#define TEST_SAMPLE_RATE 48000
+#define TEST_TONE_FREQUENCY 440
+
+struct TestStream
+{
+    AVCodecContext *codecContext = nullptr;
+    AVStream *stream = nullptr;
+
+    // Source of the raw frames
+    AVFilterGraph *graph = nullptr;
+    AVFilterContext *sink = nullptr;
+
+    qreal time = 0;         // Of the next frame, in seconds
+    bool isEnd = false;
+
+    ~TestStream()
+    {
+        avcodec_free_context(&codecContext);
+        avfilter_graph_free(&graph);
+    }
+};
+
+static QString errorString(int error)
+{
+    char buf[AV_ERROR_MAX_STRING_SIZE];
+    return QString::fromUtf8(av_make_error_string(buf, sizeof(buf), error));
+}
+
+static int openSource(TestStream &stream, const QString &filterDesc, bool isAudio)
+{
+    if(!(stream.graph = avfilter_graph_alloc()))
+        return AVERROR(ENOMEM);
+
+    int ret = 0;
+    if((ret = avfilter_graph_create_filter(&stream.sink,
+                                           avfilter_get_by_name(isAudio ? "abuffersink" : "buffersink"),
+                                           "out", nullptr, nullptr, stream.graph)) < 0)
+        return ret;
+
+    // The description starts with a source, only its end is linked
+    AVFilterInOut *input = avfilter_inout_alloc();
+    AVFilterInOut *output = nullptr;
+    if(!input)
+        return AVERROR(ENOMEM);
+
+    input->name = av_strdup("out");
+    input->next = nullptr;
+    input->pad_idx = 0;
+    input->filter_ctx = stream.sink;
+
+    ret = avfilter_graph_parse_ptr(stream.graph, filterDesc.toUtf8().constData(),
+                                   &input, &output, nullptr);
+
+    avfilter_inout_free(&input);
+    avfilter_inout_free(&output);
+
+    return ret < 0 ? ret : avfilter_graph_config(stream.graph, nullptr);
+}
+
+static int writePackets(AVFormatContext *formatContext, TestStream &stream, AVPacket *packet)
+{
+    int ret = 0;
+    while((ret = avcodec_receive_packet(stream.codecContext, packet)) >= 0)
+    {
+        av_packet_rescale_ts(packet, stream.codecContext->time_base, stream.stream->time_base);
+        packet->stream_index = stream.stream->index;
+
+        if((ret = av_interleaved_write_frame(formatContext, packet)) < 0)
+            return ret;
+    }
+
+    return ret == AVERROR(EAGAIN) || ret == AVERROR_EOF ? 0 : ret;
+}
+
+bool TestMedia::write(const QString &fileName)
+{
+    m_errorString.clear();
+    m_usedVideoEncoder.clear();
+
+    TestStream video, audio;
+    AVFormatContext *formatContext = nullptr;
+    AVPacket *packet = av_packet_alloc();
+    AVFrame *frame = av_frame_alloc();
+
+    auto cleanup = qScopeGuard([&] {
+        if(formatContext && !(formatContext->oformat->flags & AVFMT_NOFILE))
+            avio_closep(&formatContext->pb);
+
+        avformat_free_context(formatContext);
+        av_packet_free(&packet);
+        av_frame_free(&frame);
+    });
+
+    auto fail = [this](const QString &what, int error) {
+        m_errorString = what + ": " + errorString(error);
+        return false;
+    };
+
+    if(!packet || !frame)
+        return fail("Allocate the frame", AVERROR(ENOMEM));
+
+    const QByteArray path = fileName.toUtf8();
+
+    int ret = 0;
+    if((ret = avformat_alloc_output_context2(&formatContext, nullptr, "matroska", path.constData())) < 0)
+        return fail("Create the muxer", ret);
+
+    const bool isGlobalHeader = formatContext->oformat->flags & AVFMT_GLOBALHEADER;
+
+    // Video, B-frames included so the reordering is measured too
+    const AVCodec *videoCodec = avcodec_find_encoder_by_name(
+        videoEncoder.isEmpty() ? "libx264" : videoEncoder.toUtf8().constData());
+    if(!videoCodec && videoEncoder.isEmpty())
+        videoCodec = avcodec_find_encoder(AV_CODEC_ID_MPEG4);
+
+    if(!videoCodec || !(video.codecContext = avcodec_alloc_context3(videoCodec)))
+        return fail("Find the video encoder", AVERROR_ENCODER_NOT_FOUND);
+
+    video.codecContext->width = size.width();
+    video.codecContext->height = size.height();
+    video.codecContext->pix_fmt = AV_PIX_FMT_YUV420P;
+    video.codecContext->time_base = AVRational{1, fps};
+    video.codecContext->framerate = AVRational{fps, 1};
+    video.codecContext->gop_size = gopSize;
+    video.codecContext->max_b_frames = 2;
+    video.codecContext->bit_rate = qint64(size.width()) * size.height() * fps / 8;
+
+    if(isGlobalHeader)
+        video.codecContext->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+
+    if((ret = avcodec_open2(video.codecContext, videoCodec, nullptr)) < 0)
+        return fail("Open the video encoder", ret);
+
+    m_usedVideoEncoder = videoCodec->name;
+
+    if((ret = openSource(video, QString::asprintf("testsrc2=size=%dx%d:rate=%d:duration=%d,format=yuv420p",
+                                                  size.width(), size.height(), fps, duration), false)) < 0)
+        return fail("Open testsrc2", ret);
+
+    // Audio
+    if(hasAudio)
+    {
+        const AVCodec *audioCodec = avcodec_find_encoder(AV_CODEC_ID_AAC);
+        if(!audioCodec || !(audio.codecContext = avcodec_alloc_context3(audioCodec)))
+            return fail("Find the audio encoder", AVERROR_ENCODER_NOT_FOUND);
+
+        audio.codecContext->sample_fmt = AV_SAMPLE_FMT_FLTP;
+        audio.codecContext->sample_rate = TEST_SAMPLE_RATE;
+        audio.codecContext->time_base = AVRational{1, TEST_SAMPLE_RATE};
+        audio.codecContext->bit_rate = 128000;
+        av_channel_layout_default(&audio.codecContext->ch_layout, 2);
+
+        if(isGlobalHeader)
+            audio.codecContext->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+
+        if((ret = avcodec_open2(audio.codecContext, audioCodec, nullptr)) < 0)
+            return fail("Open the audio encoder", ret);
+
+        // The encoder takes fixed size frames
+        const int frameSize = audio.codecContext->frame_size > 0 ? audio.codecContext->frame_size : 1024;
+
+        if((ret = openSource(audio, QString::asprintf(
+                                        "sine=frequency=%d:sample_rate=%d:duration=%d,"
+                                        "aformat=sample_fmts=fltp:channel_layouts=stereo,"
+                                        "asetnsamples=n=%d",
+                                        TEST_TONE_FREQUENCY, TEST_SAMPLE_RATE, duration, frameSize),
+                             true)) < 0)
+            return fail("Open sine", ret);
+    }
+
+    for(TestStream *stream : {&video, &audio})
+    {
+        if(!stream->codecContext)
+            continue;
+
+        if(!(stream->stream = avformat_new_stream(formatContext, nullptr)))
+            return fail("Add the stream", AVERROR(ENOMEM));
+
+        stream->stream->time_base = stream->codecContext->time_base;
+        if((ret = avcodec_parameters_from_context(stream->stream->codecpar, stream->codecContext)) < 0)
+            return fail("Copy the codec parameters", ret);
+    }
+
+    if((ret = avio_open(&formatContext->pb, path.constData(), AVIO_FLAG_WRITE)) < 0)
+        return fail("Open " + fileName, ret);
+
+    if((ret = avformat_write_header(formatContext, nullptr)) < 0)
+        return fail("Write the header", ret);
+
+    // Interleaved by time as in a recording
+    while(!video.isEnd || (audio.codecContext && !audio.isEnd))
+    {
+        TestStream &stream = video.isEnd || (audio.codecContext && !audio.isEnd && audio.time < video.time) ?
+                                 audio : video;
+
+        if((ret = av_buffersink_get_frame(stream.sink, frame)) == AVERROR_EOF)
+        {
+            // Drain the encoder
+            stream.isEnd = true;
+            ret = avcodec_send_frame(stream.codecContext, nullptr);
+        }
+        else if(ret >= 0)
+        {
+            frame->pts = av_rescale_q(frame->pts, av_buffersink_get_time_base(stream.sink),
+                                      stream.codecContext->time_base);
+            frame->pict_type = AV_PICTURE_TYPE_NONE;
+            stream.time = frame->pts * av_q2d(stream.codecContext->time_base);
+
+            ret = avcodec_send_frame(stream.codecContext, frame);
+            av_frame_unref(frame);
+        }
+
+        if(ret < 0)
+            return fail("Encode", ret);
+
+        if((ret = writePackets(formatContext, stream, packet)) < 0)
+            return fail("Write the packet", ret);
+    }
+
+    if((ret = av_write_trailer(formatContext)) < 0)
+        return fail("Write the trailer", ret);
+
+    return true;
+}
@@ -0,0 +1,48 @@
+/**
+ * @brief Test Media
+ * @anchor Ho 229
+ * @date 2023/5/21
+ */
+
+#ifndef TESTMEDIA_H
+#define TESTMEDIA_H
+
+#include <QSize>
+#include <QString>
+
+/**
+ * @brief Encode the testsrc2 pattern and a sine tone of libavfilter into a Matroska file,
+ *        so the benchmark needs no media and gives the same input on every machine
+ */
+class TestMedia
+{
+public:
+    QSize size = QSize(1920, 1080);
+    int fps = 30;
+    int duration = 10;              // in seconds
+    int gopSize = 60;               // in frames
+    bool hasAudio = true;
+
+    /**
+     * @brief Name of the video encoder, libx264 if it is built in otherwise mpeg4 when empty
+     */
+    QString videoEncoder;
+
+    /**
+     * @return false if failed, see also TestMedia::errorString()
+     */
+    bool write(const QString &fileName);
+
+    QString errorString() const { return m_errorString; }
+
+    /**
+     * @return name of the video encoder used by the last TestMedia::write()
+     */
+    QString usedVideoEncoder() const { return m_usedVideoEncoder; }
+
+private:
+    QString m_errorString;
+    QString m_usedVideoEncoder;
+};
+
+#endif // TESTMEDIA_H
@@ -1,9 +1,13 @@
-﻿import QtQuick 2.0
+﻿import QtQuick 2.15
 import QtQuick.Controls 2.12
 
 Slider {
     id: slider
 
+    // Url of a local video file to show the thumbnail of the hovered position,
+    // the thumbnails are provided by ThumbnailProvider
+    property string previewSource: ""
+
     background: Rectangle {
         x: slider.leftPadding
         y: slider.topPadding + slider.availableHeight / 2 - height / 2
@@ -34,4 +38,26 @@ Slider {
         color: slider.pressed ? "#f0f0f0" : "#f6f6f6"
         border.color: "#bdbebf"
     }
+
+    HoverHandler { id: hoverHandler }
+
+    Image {
+        id: preview
+
+        readonly property real hoveredValue: slider.valueAt((hoverHandler.point.position.x - slider.leftPadding)
+                                                             / slider.availableWidth)
+
+        x: Math.max(0, Math.min(slider.width - width, hoverHandler.point.position.x - width / 2))
+        y: -height - 6
+
+        visible: slider.previewSource !== "" && hoverHandler.hovered && status === Image.Ready
+
+        asynchronous: true
+        cache: false
+
+        // Whole seconds, the provider generates one thumbnail per interval anyway
+        source: slider.previewSource !== "" && hoverHandler.hovered ?
+                    "image://thumbnail/" + Math.floor(hoveredValue) + "/"
+                    + encodeURIComponent(slider.previewSource) : ""
+    }
 }
@@ -44,6 +44,8 @@ Window {
         id: videoPlayer
         anchors.fill: parent
 
+        renderMode: VideoPlayer.SceneGraphRendering
+
         volume: volumeSlider.value
 
         onSourceChanged: urlTitle.toast()
@@ -69,6 +71,66 @@ Window {
         onDoubleClicked: playBtn.clicked();
     }
 
+    BusyIndicator {
+        anchors.centerIn: parent
+
+        running: videoPlayer.status == VideoPlayer.Loading
+    }
+
+    Rectangle {
+        id: statsOverlay
+
+        visible: statsCheckBox.checked && videoPlayer.playbackState !== VideoPlayer.Stopped
+
+        anchors.top: parent.top
+        anchors.right: parent.right
+        anchors.margins: 12
+
+        width: statsText.implicitWidth + 12
+        height: statsText.implicitHeight + 12
+
+        color: "#a0000000"
+        radius: 5
+
+        function formatCache(cache) {
+            return cache.frames + " / " + cache.seconds.toFixed(2) + " s / "
+                    + (cache.bytes / 1048576).toFixed(1) + " MiB";
+        }
+
+        Text {
+            id: statsText
+
+            anchors.centerIn: parent
+
+            color: "white"
+            font.family: "monospace"
+            font.pointSize: 9
+
+            text: {
+                var stats = videoPlayer.stats;
+                if (stats.decodedFrames === undefined)
+                    return "";
+
+                return "Frames: " + stats.decodedFrames + " decoded, " + stats.presentedFrames + " presented, "
+                        + stats.droppedFrames + " dropped, " + stats.skippedFrames + " skipped\n"
+                        + "Video cache: " + statsOverlay.formatCache(stats.videoCache) + "\n"
+                        + "Audio cache: " + statsOverlay.formatCache(stats.audioCache) + "\n"
+                        + "A/V offset: " + (stats.avOffset * 1000).toFixed(1) + " ms\n"
+                        + "Lateness: " + (stats.frameLateness * 1000).toFixed(1) + " ms, drop level "
+                        + stats.frameDropLevel + "\n"
+                        + "Decode: " + stats.decodeMsPerFrame.toFixed(2) + " ms/frame, "
+                        + stats.threadingMode + "\n"
+                        + "Upload: " + stats.uploadMsPerFrame.toFixed(2) + " ms/frame, "
+                        + stats.conversion
+                        + (stats.networkBuffer === undefined ? "" :
+                           "\nNetwork: " + (stats.networkBuffer.bytes / 1048576).toFixed(1) + " MiB / "
+                           + stats.networkBuffer.seconds.toFixed(1) + " s buffered, "
+                           + stats.networkBuffer.underruns + " underruns, "
+                           + (stats.networkBuffer.cachedBytes / 1048576).toFixed(1) + " MiB from the disk");
+            }
+        }
+    }
+
     Toast {
         id: urlTitle
 
@@ -343,6 +405,14 @@ Window {
 
             live: false
 
+            previewSource: videoPlayer.source
+
+            // Preview the key frames while dragging, the seeks are coalesced by the player
+            onPositionChanged: {
+                if(pressed)
+                    videoPlayer.seek(valueAt(position), true);
+            }
+
             onPressedChanged: {
                 if(!pressed)
                     videoPlayer.seek(value);
@@ -384,7 +454,7 @@ Window {
             anchors.horizontalCenter: settingsBtn.horizontalCenter
             anchors.margins: 12
 
-            height: 190
+            height: 300
             width: 150
 
             color: "black"
@@ -437,6 +507,37 @@ Window {
                             videoPlayer.activeSubtitleTrack = value
                     }
                 }
+
+                Text {
+                    text: qsTr("Playback Rate")
+                    color: "white"
+
+                    font.pointSize: 11
+                }
+
+                ComboBox {
+                    model: [ 0.25, 0.5, 1, 1.5, 2, 3, 4 ]
+                    displayText: currentText + "x"
+
+                    currentIndex: 2
+
+                    onActivated: videoPlayer.playbackRate = model[index]
+                }
+
+                CheckBox {
+                    id: statsCheckBox
+
+                    text: qsTr("Statistics")
+
+                    contentItem: Text {
+                        text: parent.text
+                        color: "white"
+                        leftPadding: parent.indicator.width + parent.spacing
+                        verticalAlignment: Text.AlignVCenter
+
+                        font.pointSize: 11
+                    }
+                }
             }
 
             HoverHandler { onHoveredChanged: parent.closeAvailable = !hovered }
@@ -478,8 +579,6 @@ Window {
 
             onDropped: {
                 if(drop.hasUrls || drop.hasText) {
-                    openBtn.text = qsTr("<font color='white'>Loading...</font>")
-
                     videoPlayer.source = drop.hasUrls ? drop.urls[0] : drop.text;
                     videoPlayer.play();
 
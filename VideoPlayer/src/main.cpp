@@ -9,6 +9,7 @@
 #include <QQmlApplicationEngine>
 
 #include "videoplayer.h"
+#include "thumbnailprovider.h"
 #include "keyboardcontrollor.h"
 
 int main(int argc, char *argv[])
@@ -27,9 +28,13 @@ int main(int argc, char *argv[])
     app.setOrganizationDomain("https://github.com/ho229v3666/");
 
     qmlRegisterType<VideoPlayer>("com.multimedia.videoplayer", 1, 0, "VideoPlayer");
+    qmlRegisterUncreatableType<PlayerConfig>("com.multimedia.videoplayer", 1, 0, "PlayerConfig",
+                                             "PlayerConfig is provided by VideoPlayer.config");
 
     KeyboardControllor qmlKey;
     QQmlApplicationEngine engine;
+    engine.addImageProvider("thumbnail", new ThumbnailProvider);
+
     const QUrl url(QStringLiteral("qrc:/main.qml"));
     QObject::connect(&engine, &QQmlApplicationEngine::objectCreated,
         &app, [url](QObject *obj, const QUrl &objUrl) {
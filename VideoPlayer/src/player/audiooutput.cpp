@@ -33,7 +33,11 @@ public:
 AudioOutput::AudioOutput(const Callback &callback, QObject *parent) :
     QObject(parent)
 {
-    m_audioDevice = new AudioDevice(callback, this);
+    m_audioDevice = new AudioDevice([this, callback](char *data, qint64 maxlen) {
+        const qint64 bytes = callback(data, maxlen);
+        m_writtenBytes += bytes;
+        return bytes;
+    }, this);
 }
 
 AudioOutput::~AudioOutput()
@@ -51,11 +55,17 @@ void AudioOutput::updateAudioOutput(const QAudioFormat &format)
 
     m_output = new QAudioOutput(format, this);
 
+    if(m_bufferSize > 0)
+        m_output->setBufferSize(m_bufferSize);
+
     // restart when encounter unexpected idle
     QObject::connect(m_output, &QAudioOutput::stateChanged, this,
                      [this](QAudio::State s) {
                          if(s == QAudio::IdleState)
+                         {
+                             m_writtenBytes = 0;
                              m_output->start(m_audioDevice);
+                         }
                      });
 }
 
@@ -75,8 +85,9 @@ void AudioOutput::play()
     if (!m_output)
         return;
 
+    // processedUSecs() restarts from 0
+    m_writtenBytes = 0;
     m_output->start(m_audioDevice);
-    m_bufferDuration = qreal(m_output->format().durationForBytes(m_output->bufferSize())) / 1000000;
 
     if (m_output->error() != QAudio::NoError)
         qCritical() << __FUNCTION__ << ":" << m_output->error();
@@ -107,18 +118,17 @@ void AudioOutput::reset()
     m_output->reset();
 
     if (previousState == QAudio::ActiveState)
+    {
+        m_writtenBytes = 0;
         m_output->start(m_audioDevice);
+    }
 }
 
-bool AudioOutput::isLowDataLeft() const
+qreal AudioOutput::queuedDuration() const
 {
     if(!m_output)
-        return false;
+        return 0;
 
-    return m_output->bytesFree() > m_output->bufferSize() * 0.75;
-}
-
-qreal AudioOutput::bufferDuration() const
-{
-    return m_bufferDuration;
+    const qint64 writtenUSecs = m_output->format().durationForBytes(m_writtenBytes);
+    return qreal(qMax(writtenUSecs - m_output->processedUSecs(), qint64(0))) / 1000000;
 }
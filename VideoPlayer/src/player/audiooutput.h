@@ -32,6 +32,13 @@ public:
     void setVolume(qreal volume);
     qreal volume() const;
 
+    /**
+     * @brief Buffer size in bytes, 0 means the default of the device,
+     *        takes effect when the audio output is updated next time
+     */
+    void setBufferSize(int bytes) { m_bufferSize = qMax(0, bytes); }
+    int bufferSize() const { return m_bufferSize; }
+
     void play();
     void pause();
     void stop();
@@ -41,13 +48,19 @@ public:
      */
     void reset();
 
-    bool isLowDataLeft() const;
-    qreal bufferDuration() const;
+    /**
+     * @brief Duration of the data written to the device but not played yet,
+     *        derived from QAudioOutput::processedUSecs()
+     * @return in seconds
+     */
+    qreal queuedDuration() const;
 
 private:
     QAudioOutput *m_output = nullptr;
     AudioDevice *m_audioDevice = nullptr;
-    qreal m_bufferDuration = 0;
+    int m_bufferSize = 0;
+
+    qint64 m_writtenBytes = 0;      // Since the device was started
 };
 
 #endif // AUDIOOUTPUT_H
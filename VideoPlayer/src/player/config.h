@@ -1,5 +1,5 @@
 /**
- * @brief Static Configurations
+ * @brief Static Configurations, the tunable ones are the defaults of PlayerConfig
  * @anchor Ho 229
  * @date 2023/4/21
  */
@@ -7,15 +7,133 @@
 #ifndef CONFIG_H
 #define CONFIG_H
 
+// Default of PlayerConfig::videoCacheSize, audioCacheSize and subtitleCacheSize,
+// the caches are normally limited by the look-ahead duration and the cache budget first
 #define VIDEO_CACHE_SIZE 256
 #define AUDIO_CACHE_SIZE 256
 #define SUBTITLE_CACHE_SIZE 64
 
-// FFmpegDecoder::decode() will be called asynchronously
-// when the time difference between the current frame and the last cached frame
-// is less than MIN_DECODED_DURATION, in seconds
-#define MIN_DECODED_DURATION 0.25
+// Default of PlayerConfig::lookAhead, the decode workers fill the caches up to
+// DEFAULT_LOOK_AHEAD and are woken up when less than half of it is left, in seconds
+#define DEFAULT_LOOK_AHEAD 0.5
 
-#define MAX_DECODED_DURATION MIN_DECODED_DURATION * 2
+// Default of PlayerConfig::cacheBudget, in bytes
+#define DEFAULT_CACHE_BUDGET (256 * 1024 * 1024)
+
+// Each cache may hold MIN_CACHED_DURATION even if the budget is exceeded,
+// so one stream could not starve the other, in seconds
+#define MIN_CACHED_DURATION 0.1
+
+// A decode worker waiting for room in the frame cache rechecks it at least every
+// CACHE_WAIT_TIMEOUT, in milliseconds
+#define CACHE_WAIT_TIMEOUT 10
+
+// Maximum count of the empty AVFrame kept by FramePool for reuse
+#define FRAME_POOL_SIZE 64
+
+// Default of PlayerConfig::packetQueueSize,
+// capacity of each per-stream packet queue filled by FFmpegDecoder::decode(), in packets
+#define PACKET_QUEUE_SIZE 128
+
+// Default of PlayerConfig::packetQueueBytes,
+// FFmpegDecoder::decode() stops demuxing when the queued packets exceed it
+#define MAX_PACKET_QUEUE_BYTES (16 * 1024 * 1024)
+
+// The clocks are set directly instead of being corrected gradually
+// when they differ by more than AV_RESYNC_THRESHOLD, in seconds
+#define AV_RESYNC_THRESHOLD 0.3
+
+// The video clock is pulled towards the audio clock by at most
+// AV_SYNC_MAX_CORRECTION of the refresh interval per vblank
+#define AV_SYNC_MAX_CORRECTION 0.1
+
+// The audio clock moves 1 / AUDIO_CLOCK_SMOOTHING of the way to each new measurement
+#define AUDIO_CLOCK_SMOOTHING 8
+
+// The drift of the audio device is estimated every AUDIO_DRIFT_INTERVAL, in milliseconds
+#define AUDIO_DRIFT_INTERVAL 5000
+
+// Maximum ratio the audio is stretched by to absorb the drift
+#define AUDIO_MAX_COMPENSATION 0.001
+
+// Bounds of VideoPlayer::playbackRate
+#define MIN_PLAYBACK_RATE 0.25
+#define MAX_PLAYBACK_RATE 4.0
+
+// The playback rate is passed to the decoder in thousandths
+#define PLAYBACK_RATE_UNIT 1000
+
+// The lateness of the presentation moves 1 / FRAME_LATENESS_SMOOTHING
+// of the way to each new measurement
+#define FRAME_LATENESS_SMOOTHING 16
+
+// The frame drop level of the decoder is raised when the smoothed lateness exceeds
+// FRAME_DROP_RAISE_LATENESS and lowered below FRAME_DROP_LOWER_LATENESS, in seconds
+#define FRAME_DROP_RAISE_LATENESS 0.05
+#define FRAME_DROP_LOWER_LATENESS 0.005
+
+// The frame drop level is kept for FRAME_DROP_HOLD at least, in milliseconds
+#define FRAME_DROP_HOLD 2000
+
+// The window is taken as not rendering, eg. minimized, when no frame has been swapped
+// for RENDER_STALL_FRAMES frame intervals, the GUI thread presents instead
+#define RENDER_STALL_FRAMES 4
+
+// Default of PlayerConfig::statsInterval, in milliseconds
+#define DEFAULT_STATS_INTERVAL 1000
+
+// ThumbnailGenerator decodes a key frame every THUMBNAIL_INTERVAL, in seconds
+#define THUMBNAIL_INTERVAL 10
+
+// Width of the thumbnails, the height keeps the display aspect ratio
+#define THUMBNAIL_WIDTH 160
+
+// Memory of the thumbnails kept by ThumbnailGenerator, in bytes
+#define THUMBNAIL_CACHE_SIZE (8 * 1024 * 1024)
+
+// Default of PlayerConfig::thumbnailDiskCacheSize, in bytes
+#define DEFAULT_THUMBNAIL_DISK_CACHE_SIZE (256LL * 1024 * 1024)
+
+// Packets read after a seek to find a key frame before giving up
+#define THUMBNAIL_MAX_PACKETS 256
+
+// ThumbnailProvider waits at most THUMBNAIL_WAIT_TIMEOUT for a thumbnail, in milliseconds
+#define THUMBNAIL_WAIT_TIMEOUT 500
+
+// Tracer writes the events to the file in chunks of TRACE_BUFFER_SIZE, in bytes
+#define TRACE_BUFFER_SIZE (64 * 1024)
+
+// MappedFileIO hints the kernel to read MAPPED_IO_READ_AHEAD ahead of the demuxer,
+// again once half of it has been read, in bytes
+#define MAPPED_IO_READ_AHEAD (16 * 1024 * 1024)
+
+// Buffer of the AVIOContext of MappedFileIO, larger reads are copied directly, in bytes
+#define MAPPED_IO_BUFFER_SIZE (64 * 1024)
+
+// Default of PlayerConfig::networkBufferSize, in bytes
+#define DEFAULT_NETWORK_BUFFER_SIZE (64 * 1024 * 1024)
+
+// Default of PlayerConfig::networkReadAhead, in seconds
+#define DEFAULT_NETWORK_READ_AHEAD 60
+
+// NetworkInput reads at most NETWORK_READ_SIZE from the network at once, in bytes
+#define NETWORK_READ_SIZE (256 * 1024)
+
+// Buffer of the AVIOContext of NetworkInput, in bytes
+#define NETWORK_IO_BUFFER_SIZE (64 * 1024)
+
+// Default of PlayerConfig::diskCacheSize, in bytes
+#define DEFAULT_DISK_CACHE_SIZE (1024LL * 1024 * 1024)
+
+// RangeCache writes its index every RANGE_CACHE_INDEX_INTERVAL of new data besides on close,
+// what is written after it is lost on a crash, in bytes
+#define RANGE_CACHE_INDEX_INTERVAL (16 * 1024 * 1024)
+
+// The leading RANGE_CACHE_VALIDATOR_SIZE of a resource are fetched on open to validate
+// its RangeCache entry, in bytes
+#define RANGE_CACHE_VALIDATOR_SIZE (4 * 1024)
+
+// Default of PlayerConfig::probeDuration, in seconds, 0 means the default of FFmpeg
+#define DEFAULT_PROBE_DURATION 0
 
 #endif // CONFIG_H
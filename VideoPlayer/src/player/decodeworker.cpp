@@ -0,0 +1,58 @@
+/**
+ * @brief Decode Worker
+ * @anchor Ho 229
+ * @date 2023/5/6
+ */
+
+#include "decodeworker.h"
+#include "packetqueue.h"
+
+#include <ffmpeg.h>
+
+DecodeWorker::DecodeWorker(PacketQueue *queue, const Handler &handler, QObject *parent) :
+    QThread(parent),
+    m_queue(queue),
+    m_handler(handler)
+{
+
+}
+
+DecodeWorker::~DecodeWorker()
+{
+    this->stop();
+}
+
+void DecodeWorker::launch()
+{
+    if(this->isRunning())
+        return;
+
+    m_isDrained = false;
+    m_queue->start();
+    this->start();
+}
+
+void DecodeWorker::stop()
+{
+    if(!this->isRunning())
+        return;
+
+    this->requestInterruption();
+    m_queue->abort();
+    this->wait();
+}
+
+void DecodeWorker::run()
+{
+    AVPacket *packet = nullptr;
+    while(!this->isInterruptionRequested() && (packet = m_queue->take()))
+    {
+        const bool isEnd = PacketQueue::isEndPacket(packet);
+
+        m_handler(packet);
+        av_packet_free(&packet);
+
+        if(isEnd)
+            m_isDrained = true;
+    }
+}
@@ -0,0 +1,57 @@
+/**
+ * @brief Decode Worker
+ * @anchor Ho 229
+ * @date 2023/5/6
+ */
+
+#ifndef DECODEWORKER_H
+#define DECODEWORKER_H
+
+#include <functional>
+
+#include <QThread>
+
+struct AVPacket;
+
+class PacketQueue;
+
+/**
+ * @brief Drain a PacketQueue on its own thread and pass every packet to the handler
+ */
+class DecodeWorker final : public QThread
+{
+    Q_OBJECT
+public:
+    using Handler = std::function<void(AVPacket *)>;
+
+    explicit DecodeWorker(PacketQueue *queue, const Handler &handler,
+                          QObject *parent = nullptr);
+    ~DecodeWorker() Q_DECL_OVERRIDE;
+
+    /**
+     * @brief Reopen the packet queue and start the thread
+     */
+    void launch();
+
+    /**
+     * @brief Abort the packet queue and wait for the thread finished
+     * @note The handler should check QThread::isInterruptionRequested()
+     *       before blocking on anything other than the packet queue
+     */
+    void stop();
+
+    /**
+     * @return true if the end packet has been handled, that is the codec has been drained
+     */
+    bool isDrained() const { return m_isDrained; }
+
+private:
+    void run() Q_DECL_OVERRIDE;
+
+    PacketQueue *const m_queue;
+    const Handler m_handler;
+
+    volatile bool m_isDrained = false;
+};
+
+#endif // DECODEWORKER_H
@@ -5,13 +5,19 @@
  */
 
 #include "config.h"
+#include "decodeworker.h"
 #include "ffmpegdecoder.h"
+#include "keyframeindex.h"
+#include "mappedfileio.h"
+#include "networkinput.h"
+#include "tracer.h"
 
 #include <QDir>
+#include <QThread>
 #include <QFileInfo>
+#include <QElapsedTimer>
 #include <QMetaObject>
 #include <QScopeGuard>
-#include <QMutexLocker>
 
 static bool initFlag = false;
 
@@ -29,10 +35,29 @@ template <typename T>
 static void findStreams(const AVFormatContext *format, AVMediaType type, QList<T> &list);
 
 inline static qreal second(const qint64 pts, const AVRational timebase);
-inline static qreal decodedDuration(const QContiguousCache<AVFrame *> &cache);
+
+/**
+ * @return true if the frames of the format are uploaded without the conversion,
+ *         keep it in sync with VideoRenderer
+ */
+static bool isNativeFormat(int format);
+
+/**
+ * @return true if the header tells what the video and audio codecs need to be opened
+ */
+static bool hasCodecParameters(const AVFormatContext *format);
 
 FFmpegDecoder::FFmpegDecoder(QObject *parent) :
-    QObject(parent)
+    QObject(parent),
+    m_videoCache(VIDEO_CACHE_SIZE, [](AVFrame *frame) { av_frame_free(&frame); }),
+    m_audioCache(AUDIO_CACHE_SIZE, [](AVFrame *frame) { av_frame_free(&frame); }),
+    m_subtitleCache(SUBTITLE_CACHE_SIZE, [](SubtitleFrame *frame) { delete frame; }),
+    m_videoPackets(PACKET_QUEUE_SIZE),
+    m_audioPackets(PACKET_QUEUE_SIZE),
+    m_subtitlePackets(PACKET_QUEUE_SIZE),
+    m_cacheBudget(DEFAULT_CACHE_BUDGET),
+    m_lookAhead(DEFAULT_LOOK_AHEAD),
+    m_packetQueueBytes(MAX_PACKET_QUEUE_BYTES)
 {
     if(!initFlag)
     {
@@ -42,14 +67,33 @@ FFmpegDecoder::FFmpegDecoder(QObject *parent) :
 
     av_log_set_level(AV_LOG_INFO);
 
-    m_videoCache.setCapacity(VIDEO_CACHE_SIZE);
-    m_audioCache.setCapacity(AUDIO_CACHE_SIZE);
-    m_subtitleCache.setCapacity(SUBTITLE_CACHE_SIZE);
+    m_videoWorker = new DecodeWorker(&m_videoPackets, [this](AVPacket *packet) {
+        this->decodeVideo(packet);
+        this->requestDemux(&m_videoPackets);
+    }, this);
+    m_videoWorker->setObjectName("VideoDecodeWorker");
+
+    m_audioWorker = new DecodeWorker(&m_audioPackets, [this](AVPacket *packet) {
+        this->decodeAudio(packet);
+        this->requestDemux(&m_audioPackets);
+    }, this);
+    m_audioWorker->setObjectName("AudioDecodeWorker");
+
+    m_subtitleWorker = new DecodeWorker(&m_subtitlePackets, [this](AVPacket *packet) {
+        this->decodeSubtitle(packet);
+    }, this);
+    m_subtitleWorker->setObjectName("SubtitleDecodeWorker");
+
+    m_keyframeIndex = new KeyframeIndex(this);
+    m_mappedFile = new MappedFileIO;
+    m_networkInput = new NetworkInput(this);
 }
 
 FFmpegDecoder::~FFmpegDecoder()
 {
     this->release();
+
+    delete m_mappedFile;
 }
 
 int FFmpegDecoder::activeVideoTrack() const
@@ -80,6 +124,12 @@ void FFmpegDecoder::setActiveVideoTrack(int index)
     if(m_state == Closed || index >= m_videoIndexes.size())
         return;
 
+    const bool isRunning = this->stopWorkers();
+    auto restart = qScopeGuard([=] {
+        if(isRunning)
+            this->startWorkers();
+    });
+
     this->clearCache();
 
     // Release previous active track
@@ -90,6 +140,9 @@ void FFmpegDecoder::setActiveVideoTrack(int index)
             return;
 
         m_fps = qQNaN();
+        m_activeThreadingMode.storeRelaxed(NoThreading);
+        m_isVideoConverted.storeRelaxed(0);
+        m_videoFormat = AV_PIX_FMT_NONE;
 
         this->closeCodecContext(m_videoStream, m_videoCodecContext);
         if(m_swsContext)
@@ -104,22 +157,17 @@ void FFmpegDecoder::setActiveVideoTrack(int index)
                                             AVMEDIA_TYPE_VIDEO, m_videoIndexes[index]))
         return;
 
-    // Convert to supported format if not
-    switch(m_videoCodecContext->pix_fmt)
+    // active_thread_type is set by avcodec_open2()
+    switch(m_videoCodecContext->active_thread_type)
     {
-    case AV_PIX_FMT_YUV420P:
-    case AV_PIX_FMT_YUV420P10LE:
-    case AV_PIX_FMT_YUV444P:
-    case AV_PIX_FMT_YUV444P10LE:
+    case FF_THREAD_FRAME:
+        m_activeThreadingMode.storeRelaxed(FrameThreading);
+        break;
+    case FF_THREAD_SLICE:
+        m_activeThreadingMode.storeRelaxed(SliceThreading);
         break;
     default:
-        m_swsContext = sws_getContext(m_videoCodecContext->width,
-                                      m_videoCodecContext->height,
-                                      m_videoCodecContext->pix_fmt,
-                                      m_videoCodecContext->width,
-                                      m_videoCodecContext->height,
-                                      AV_PIX_FMT_YUV420P,
-                                      SWS_BICUBIC, nullptr, nullptr, nullptr);
+        m_activeThreadingMode.storeRelaxed(NoThreading);
         break;
     }
 
@@ -134,6 +182,12 @@ void FFmpegDecoder::setActiveAudioTrack(int index)
     if(m_state == Closed || index >= m_audioIndexes.size())
         return;
 
+    const bool isRunning = this->stopWorkers();
+    auto restart = qScopeGuard([=] {
+        if(isRunning)
+            this->startWorkers();
+    });
+
     this->clearCache();
 
     // Release previous active track
@@ -146,6 +200,8 @@ void FFmpegDecoder::setActiveAudioTrack(int index)
         this->closeCodecContext(m_audioStream, m_audioCodecContext);
         if(m_swrContext)
             swr_free(&m_swrContext);
+
+        this->closeTempoFilter();
     }
 
     // Initialize audio codec context
@@ -153,22 +209,21 @@ void FFmpegDecoder::setActiveAudioTrack(int index)
                                              AVMEDIA_TYPE_AUDIO, m_audioIndexes[index]))
         return;
 
-    // Convert to supported format if not
-    if(m_audioCodecContext->sample_fmt != AV_SAMPLE_FMT_S16 ||
-        m_audioCodecContext->ch_layout.nb_channels != 2)
-    {
-        AVChannelLayout dest;
-        av_channel_layout_default(&dest, 2);
-        swr_alloc_set_opts2(&m_swrContext,
-                            &dest,
-                            AV_SAMPLE_FMT_S16,
-                            m_audioCodecContext->sample_rate,
-                            &m_audioCodecContext->ch_layout,
-                            m_audioCodecContext->sample_fmt,
-                            m_audioCodecContext->sample_rate,
-                            0, nullptr);
-        swr_init(m_swrContext);
-    }
+    // Convert to supported format, it is a copy if supported already
+    // but the drift compensation needs the resampler anyway
+    AVChannelLayout dest;
+    av_channel_layout_default(&dest, 2);
+    swr_alloc_set_opts2(&m_swrContext,
+                        &dest,
+                        AV_SAMPLE_FMT_S16,
+                        m_audioCodecContext->sample_rate,
+                        &m_audioCodecContext->ch_layout,
+                        m_audioCodecContext->sample_fmt,
+                        m_audioCodecContext->sample_rate,
+                        0, nullptr);
+    swr_init(m_swrContext);
+
+    m_compensatedSamples = 0;
 
     emit activeAudioTrackChanged(index);
 }
@@ -180,6 +235,12 @@ void FFmpegDecoder::setActiveSubtitleTrack(int index)
     if(m_state == Closed || index >= m_subtitleIndexes.size() || m_subtitleIndex == index)
         return;
 
+    const bool isRunning = this->stopWorkers();
+    auto restart = qScopeGuard([=] {
+        if(isRunning)
+            this->startWorkers();
+    });
+
     // Release previous active track
     if(m_subtitleCodecContext && m_subtitleStream)
         this->closeCodecContext(m_subtitleStream, m_subtitleCodecContext);
@@ -187,50 +248,29 @@ void FFmpegDecoder::setActiveSubtitleTrack(int index)
         this->closeSubtitleFilter();
 
     m_subtitleIndex = -1;
+    m_isSubtitleFilterPending = false;
 
     this->clearCache();
 
     if(index < 0 || !m_videoCodecContext)
         return;
 
-    const AVRational timeBase = m_videoStream->time_base;
-    const AVRational pixelAspect = m_videoCodecContext->sample_aspect_ratio;
-    const QString args = QString::asprintf(
-        "video_size=%dx%d:pix_fmt=%d:time_base=%d/%d:pixel_aspect=%d/%d",
-        m_videoCodecContext->width, m_videoCodecContext->height,
-        m_videoCodecContext->pix_fmt, timeBase.num, timeBase.den,
-        pixelAspect.num, pixelAspect.den);
+    const QString filterDesc = this->subtitleFilterDesc(index);
 
-    auto makeFilterDesc = [this](const QString fileName, int relativeIndex) -> QString {
-        return QString("subtitles=filename='%1':original_size=%2x%3:si=%4")
-            .arg(fileName)
-            .arg(m_videoCodecContext->width)
-            .arg(m_videoCodecContext->height)
-            .arg(relativeIndex);
-    };
-    auto convertPath = [](QString fileName) -> QString {
-#ifdef Q_OS_WIN
-        fileName.replace('/', "\\\\");
-        return fileName.insert(fileName.indexOf(":\\"), char('\\'));
-#else
-        return fileName;
-#endif
-    };
-
-    if(m_subtitleIndexes[index].type() == QVariant::Int)            // Embedded subtitle
+    // The pixel format of a codec opened from the header is known from the first frame,
+    // the filter is opened by the video worker then, see also FFmpegDecoder::updateVideoFormat()
+    if(!filterDesc.isEmpty() && m_videoCodecContext->pix_fmt == AV_PIX_FMT_NONE)
     {
-        const QString subtitleFileName = m_url.toLocalFile();
-
-        if(!subtitleFileName.isEmpty() &&
-            this->openSubtitleFilter(args, makeFilterDesc(convertPath(subtitleFileName), index)))
-            m_subtitleIndex = index;
-        else if(this->openCodecContext(m_subtitleStream, m_subtitleCodecContext,
-                                        AVMEDIA_TYPE_SUBTITLE, m_subtitleIndexes[index].toInt()))
-            m_subtitleIndex = index;
+        m_isSubtitleFilterPending = true;
+        m_subtitleIndex = index;
     }
-    else if(m_subtitleIndexes[index].type() == QVariant::String)    // External subtitles
-        if(this->openSubtitleFilter(args, makeFilterDesc(convertPath(m_subtitleIndexes[index].toString()), 0)))
-            m_subtitleIndex = index;
+    else if(!filterDesc.isEmpty() &&
+             this->openSubtitleFilter(this->subtitleFilterArgs(m_videoCodecContext->pix_fmt), filterDesc))
+        m_subtitleIndex = index;
+    else if(m_subtitleIndexes[index].type() == QVariant::Int &&      // Embedded subtitle
+             this->openCodecContext(m_subtitleStream, m_subtitleCodecContext,
+                                    AVMEDIA_TYPE_SUBTITLE, m_subtitleIndexes[index].toInt()))
+        m_subtitleIndex = index;
 
     emit activeSubtitleTrackChanged(index);
 }
@@ -238,15 +278,12 @@ void FFmpegDecoder::setActiveSubtitleTrack(int index)
 bool FFmpegDecoder::seekable() const
 {
     // return m_formatContext ? m_formatContext->pb->seekable : false;
-    return m_url.isLocalFile();
+    return m_url.isLocalFile() || m_networkInput->isSeekable();
 }
 
 int FFmpegDecoder::duration() const
 {
-    if(!m_formatContext || !this->seekable())
-        return 0;
-
-    return static_cast<int>(m_formatContext->duration / AV_TIME_BASE);
+    return m_duration.loadRelaxed();
 }
 
 int FFmpegDecoder::videoTrackCount() const
@@ -264,54 +301,111 @@ int FFmpegDecoder::subtitleTrackCount() const
     return m_subtitleIndexes.size();
 }
 
+void FFmpegDecoder::requestLoad()
+{
+    m_loadSerial.storeRelease(m_interruptSerial.loadAcquire());
+    QMetaObject::invokeMethod(this, &FFmpegDecoder::load, Qt::QueuedConnection);
+}
+
 void FFmpegDecoder::load()
 {
     this->release();        // Reset
 
+    // Let FFmpegDecoder::requestInterrupt() abort the load, also before it has started
+    m_runnable = true;
+    if(m_loadSerial.loadAcquire() != m_interruptSerial.loadAcquire())
+        return;
+
+    m_state = Loading;
+    emit stateChanged(m_state);
+
     int ret = 0;
 
     const QString url = m_url.isLocalFile() ? m_url.toLocalFile() : m_url.toString();
 
-    // Open file
-    // Note that FFmpeg accepts filename encoded in UTF-8
-    if((ret = avformat_open_input(&m_formatContext, url.toUtf8().data(),
-             nullptr, nullptr)) < 0)
+    if(!(m_formatContext = avformat_alloc_context()))
     {
-        FFMPEG_ERROR(ret);
-        emit stateChanged(Closed);
+        FFMPEG_ERROR(AVERROR(ENOMEM));
+        this->release();
         return;
     }
 
-    // Find stream info
-    if((ret = avformat_find_stream_info(m_formatContext, nullptr)) < 0)
+    // The protocols and the probing give up once interrupted
+    m_formatContext->interrupt_callback = { &FFmpegDecoder::isLoadInterrupted, this };
+
+    if(m_probeDuration > 0)
+        m_formatContext->max_analyze_duration = static_cast<int64_t>(m_probeDuration * AV_TIME_BASE);
+
+    // The demuxer reads the mapped local file without the syscalls of the file protocol,
+    // the rest and the files which could not be mapped go through the protocols
+    if(m_url.isLocalFile() && m_isMappingFiles && m_mappedFile->open(url))
+        m_formatContext->pb = m_mappedFile->context();
+
+    // The byte streams of the network are read ahead by their own thread
+    else if(!m_url.isLocalFile() && m_networkBufferSize > 0 &&
+             QStringList({"http", "https", "ftp"}).contains(m_url.scheme(), Qt::CaseInsensitive))
+    {
+        if((ret = m_networkInput->open(url, m_networkBufferSize, m_diskCacheSize)) < 0)
+        {
+            FFMPEG_ERROR(ret);
+            this->release();
+            return;
+        }
+
+        m_formatContext->pb = m_networkInput->context();
+    }
+
+    // Open file
+    // Note that FFmpeg accepts filename encoded in UTF-8
+    if((ret = avformat_open_input(&m_formatContext, url.toUtf8().data(),
+             nullptr, nullptr)) < 0)
     {
         FFMPEG_ERROR(ret);
         this->release();
         return;
     }
 
-    // Print file infomation
-    av_dump_format(m_formatContext, 0, m_formatContext->url, 0);
+    // The tracks of the formats with a header are known before probing the packets
+    const bool hasHeader = !(m_formatContext->ctx_flags & AVFMTCTX_NOHEADER) &&
+                           m_formatContext->nb_streams && m_formatContext->duration != AV_NOPTS_VALUE;
+    if(hasHeader)
+        this->findTracks(url);
 
-    findStreams(m_formatContext, AVMEDIA_TYPE_VIDEO, m_videoIndexes);
+    // The codecs are opened from the header if it tells their parameters,
+    // so the first frame does not wait for probing the packets
+    if(!hasHeader || !hasCodecParameters(m_formatContext))
+    {
+        if((ret = avformat_find_stream_info(m_formatContext, nullptr)) < 0)
+        {
+            FFMPEG_ERROR(ret);
+            this->release();
+            return;
+        }
+    }
 
-    findStreams(m_formatContext, AVMEDIA_TYPE_AUDIO, m_audioIndexes);
+    if(!hasHeader)
+        this->findTracks(url);
 
-    findStreams(m_formatContext, AVMEDIA_TYPE_SUBTITLE, m_subtitleIndexes);
-    if(m_url.isLocalFile())
+    if(m_networkInput->isOpen())
     {
-        // Scan the external subtitle files
-        const QFileInfo fileInfo(url);
-        const QDir subtitleDir(fileInfo.absoluteDir());
-        const QStringList subtitleFiles =
-            subtitleDir.entryList({{"*.ass"}, {"*.srt"}, {"*.lrc"}}, QDir::Files)
-                .filter(fileInfo.baseName());
+        // Estimated by the probing, from the size otherwise
+        qint64 bitRate = m_formatContext->bit_rate;
+        const int64_t size = avio_size(m_formatContext->pb);
+        if(bitRate <= 0 && size > 0 && m_formatContext->duration > 0)
+            bitRate = av_rescale(size * 8, AV_TIME_BASE, m_formatContext->duration);
 
-        for(const auto &file : subtitleFiles)
-            m_subtitleIndexes.append(subtitleDir.filePath(file));
+        m_networkInput->setReadAhead(m_networkReadAhead, bitRate);
     }
 
-    m_state = Opened;
+    // Print file infomation
+    av_dump_format(m_formatContext, 0, m_formatContext->url, 0);
+
+    // Stopped while probing
+    if(!m_runnable)
+    {
+        this->release();
+        return;
+    }
 
     this->setActiveVideoTrack(0);
     this->setActiveAudioTrack(0);
@@ -325,28 +419,88 @@ void FFmpegDecoder::load()
         return;
     }
 
+    m_state = Opened;
     m_isEnd = false;
     m_runnable = true;
 
+    // The demuxer bisects the file to seek without its own index, eg. MPEG-TS
+    if(m_url.isLocalFile() && m_videoStream && !qIsNaN(m_fps) &&
+        !(m_formatContext->iformat->flags & AVFMT_NO_BYTE_SEEK) &&
+        !avformat_index_get_entries_count(m_videoStream))
+        m_keyframeIndex->load(url, m_videoStream->index);
+
     emit stateChanged(m_state);
 
+    this->startWorkers();
+
     // runs on the same thread so doesn't need to be called by signal
     this->decode();
 }
 
+void FFmpegDecoder::findTracks(const QString &url)
+{
+    findStreams(m_formatContext, AVMEDIA_TYPE_VIDEO, m_videoIndexes);
+
+    findStreams(m_formatContext, AVMEDIA_TYPE_AUDIO, m_audioIndexes);
+
+    findStreams(m_formatContext, AVMEDIA_TYPE_SUBTITLE, m_subtitleIndexes);
+    if(m_url.isLocalFile())
+    {
+        // Scan the external subtitle files
+        const QFileInfo fileInfo(url);
+        const QDir subtitleDir(fileInfo.absoluteDir());
+        const QStringList subtitleFiles =
+            subtitleDir.entryList({{"*.ass"}, {"*.srt"}, {"*.lrc"}}, QDir::Files)
+                .filter(fileInfo.baseName());
+
+        for(const auto &file : subtitleFiles)
+            m_subtitleIndexes.append(subtitleDir.filePath(file));
+    }
+
+    if(this->seekable() && m_formatContext->duration != AV_NOPTS_VALUE)
+        m_duration.storeRelaxed(static_cast<int>(m_formatContext->duration / AV_TIME_BASE));
+
+    emit tracksFound();
+}
+
+int FFmpegDecoder::isLoadInterrupted(void *opaque)
+{
+    const FFmpegDecoder *decoder = static_cast<FFmpegDecoder *>(opaque);
+    return decoder->m_state == Loading && !decoder->m_runnable;
+}
+
 void FFmpegDecoder::release()
 {
     if(m_state == Closed)
         return;
 
+    this->stopWorkers();
+    m_keyframeIndex->reset();
+
     this->setActiveVideoTrack(-1);
     this->setActiveAudioTrack(-1);
     this->setActiveSubtitleTrack(-1);
 
     avformat_close_input(&m_formatContext);
+    m_mappedFile->close();
+    m_networkInput->close();
+
+    m_framePool.clear();
 
     m_seekTarget = -1;
+    m_isReadInterrupted = false;
+    m_lastPacketTime = AV_NOPTS_VALUE;
+    m_lastVideoPts = AV_NOPTS_VALUE;
+    m_skippedFrames.storeRelaxed(0);
+    m_frameDropLevel.storeRelaxed(NoFrameDrop);
+
+    m_scaleTime.storeRelaxed(0);
+    m_resampleTime.storeRelaxed(0);
+
+    m_decodedFrames.storeRelaxed(0);
+    m_decodeTime.storeRelaxed(0);
 
+    m_duration.storeRelaxed(0);
     m_videoIndexes.clear();
     m_audioIndexes.clear();
     m_subtitleIndexes.clear();
@@ -355,28 +509,97 @@ void FFmpegDecoder::release()
     emit stateChanged(m_state);
 }
 
-void FFmpegDecoder::seek(int position)
+void FFmpegDecoder::requestInterrupt()
+{
+    // Before the flag, see also FFmpegDecoder::load()
+    m_interruptSerial.ref();
+    m_runnable = false;
+    m_networkInput->interrupt();
+}
+
+int FFmpegDecoder::requestSeek(int position, bool isAccurate)
+{
+    // A preview and the accurate seek to the same position are told apart by it
+    const int serial = (m_seekSerial.fetchAndAddOrdered(1) + 1) & 0x7fffffff;
+    m_seekRequest.storeRelease(qint64(serial) << 32 | qint64(position) << 1 | qint64(isAccurate));
+
+    // Let the demuxing stop as soon as possible
+    this->requestInterrupt();
+
+    if(m_isSeekQueued.testAndSetOrdered(0, 1))
+        QMetaObject::invokeMethod(this, &FFmpegDecoder::processSeek, Qt::QueuedConnection);
+
+    return serial;
+}
+
+void FFmpegDecoder::processSeek()
+{
+    // A request after this point queues another call
+    m_isSeekQueued.storeRelease(0);
+
+    const qint64 request = m_seekRequest.fetchAndStoreOrdered(-1);
+    if(request < 0)
+        return;
+
+    const int position = int((request & 0xffffffff) >> 1);
+    this->seek(position, request & 1);
+
+    emit seeked(position, int(request >> 32));
+}
+
+void FFmpegDecoder::seek(int position, bool isAccurate)
 {
     m_runnable = true;
 
     if(m_state == Closed)
         return;
 
-    // Clear frame cache
+    // The seek of the demuxer may read
+    m_networkInput->resume();
+
+    this->stopWorkers();
+
+    // Clear frame and packet cache
     this->clearCache();
 
-    m_seekTarget = position;
+    // The frames before the target are dropped by the decode workers
+    m_seekTarget = isAccurate && m_isAccurateSeek ? position : -1;
+    m_isEnd = false;
+
+    // Demuxed again from the seek anyway
+    m_isReadInterrupted = false;
+    m_lastPacketTime = qint64(position) * AV_TIME_BASE;
 
     if(m_videoCodecContext)
+    {
         avcodec_flush_buffers(m_videoCodecContext);
+
+        m_videoCodecContext->skip_frame = AVDISCARD_DEFAULT;
+        m_videoCodecContext->skip_loop_filter = AVDISCARD_DEFAULT;
+
+        m_lastVideoPts = AV_NOPTS_VALUE;
+    }
+
     if(m_audioCodecContext)
         avcodec_flush_buffers(m_audioCodecContext);
 
+    this->closeTempoFilter();
+
+    // Jump to the preceding key frame directly if it is indexed
+    KeyframeIndex::Entry keyframe;
+    if(m_videoStream && m_keyframeIndex->streamIndex() == m_videoStream->index &&
+        m_keyframeIndex->find(position, keyframe) &&
+        av_seek_frame(m_formatContext, -1, keyframe.offset, AVSEEK_FLAG_BYTE) >= 0)
+    {
+        this->startWorkers();
+        return;
+    }
+
     const AVStream *seekStream = qIsNaN(m_fps) ? m_audioStream : m_videoStream;
     av_seek_frame(m_formatContext, seekStream->index, static_cast<qint64>
-                  (position / av_q2d(seekStream->time_base)), AVSEEK_FLAG_FRAME);
+                  (position / av_q2d(seekStream->time_base)), AVSEEK_FLAG_BACKWARD);
 
-    QMetaObject::invokeMethod(this, &FFmpegDecoder::decode, Qt::QueuedConnection);
+    this->startWorkers();
 }
 
 AVFrame *FFmpegDecoder::takeVideoFrame()
@@ -385,20 +608,11 @@ AVFrame *FFmpegDecoder::takeVideoFrame()
         return nullptr;
 
     AVFrame *frame = nullptr;
-    m_mutex.lock();
-
-    if(!m_videoCache.isEmpty())
-        frame = m_videoCache.takeFirst();
+    m_videoCache.pop(frame);
 
-    if(!m_isEnd && !m_isDecoding && !qIsNaN(m_fps) &&
-        decodedDuration(m_videoCache) < MIN_DECODED_DURATION)
-    {
-        m_isDecoding = true;
-        // Asynchronous call FFmpegDecoder::decode()
-        QMetaObject::invokeMethod(this, &FFmpegDecoder::decode, Qt::QueuedConnection);
-    }
-
-    m_mutex.unlock();
+    // Wake up the video decode worker
+    if(m_videoCache.duration() < this->lookAhead() / 2)
+        m_videoCache.wake();
 
     return frame;
 }
@@ -408,31 +622,34 @@ AVFrame *FFmpegDecoder::takeAudioFrame()
     if(m_state == Closed)
         return nullptr;
 
-    QMutexLocker locker(&m_mutex);
-    if(m_audioCache.isEmpty())
-        return nullptr;
-
-    AVFrame *frame = m_audioCache.takeFirst();
+    AVFrame *frame = nullptr;
+    m_audioCache.pop(frame);
 
-    if(!m_isEnd && !m_isDecoding &&
-        decodedDuration(m_audioCache) < MIN_DECODED_DURATION)
-    {
-        m_isDecoding = true;
-        // Asynchronous call FFmpegDecoder::decode()
-        QMetaObject::invokeMethod(this, &FFmpegDecoder::decode, Qt::QueuedConnection);
-    }
+    // Wake up the audio decode worker
+    if(m_audioCache.duration() < this->lookAhead() / 2)
+        m_audioCache.wake();
 
     return frame;
 }
 
 SubtitleFrame *FFmpegDecoder::takeSubtitleFrame(qreal time)
 {
-    QMutexLocker locker(&m_mutex);
-
-    if(m_subtitleCache.isEmpty() || m_subtitleCache.first()->start > time)
+    SubtitleFrame *const *first = m_subtitleCache.front();
+    if(!first || (*first)->start > time)
         return nullptr;
 
-    return m_subtitleCache.takeFirst();
+    SubtitleFrame *frame = nullptr;
+    m_subtitleCache.pop(frame);
+    m_subtitleCache.wake();
+
+    return frame;
+}
+
+void FFmpegDecoder::clearFrames()
+{
+    m_videoCache.clear();
+    m_audioCache.clear();
+    m_subtitleCache.clear();
 }
 
 const QAudioFormat FFmpegDecoder::audioFormat() const
@@ -472,111 +689,378 @@ qreal FFmpegDecoder::frameDuration(const AVFrame *frame)
     return static_cast<qreal>(frame->duration) * av_q2d(frame->time_base);
 }
 
+qint64 FFmpegDecoder::frameBytes(const AVFrame *frame)
+{
+    qint64 bytes = 0;
+    for(const AVBufferRef *buf : frame->buf)
+    {
+        if(buf)
+            bytes += buf->size;
+    }
+
+    for(int i = 0; i < frame->nb_extended_buf; ++i)
+        bytes += frame->extended_buf[i]->size;
+
+    return bytes;
+}
+
+qint64 FFmpegDecoder::residentBytes() const
+{
+    return m_videoCache.bytes() + m_audioCache.bytes() + m_subtitleCache.bytes();
+}
+
+void FFmpegDecoder::setConfig(const PlayerConfig *config)
+{
+    if(m_state != Closed)
+        return;
+
+    m_videoCache.setCapacity(config->videoCacheSize());
+    m_audioCache.setCapacity(config->audioCacheSize());
+    m_subtitleCache.setCapacity(config->subtitleCacheSize());
+
+    m_videoPackets.setCapacity(config->packetQueueSize());
+    m_audioPackets.setCapacity(config->packetQueueSize());
+    m_subtitlePackets.setCapacity(config->packetQueueSize());
+
+    m_cacheBudget = qMax<qint64>(0, config->cacheBudget());
+    m_lookAhead = qMax<qreal>(0, config->lookAhead());
+    m_packetQueueBytes = qMax<qint64>(0, config->packetQueueBytes());
+
+    m_threadingMode = static_cast<ThreadingMode>(config->threadingMode());
+    m_threadCount = qMax(0, config->decodeThreadCount());
+
+    m_isAccurateSeek = config->seekMode() == PlayerConfig::AccurateSeek;
+    m_isMappingFiles = config->mapLocalFiles();
+    m_networkBufferSize = qMax<qint64>(0, config->networkBufferSize());
+    m_networkReadAhead = qMax<qreal>(0, config->networkReadAhead());
+    m_diskCacheSize = qMax<qint64>(0, config->diskCacheSize());
+    m_probeDuration = qMax<qreal>(0, config->probeDuration());
+}
+
+bool FFmpegDecoder::isEnd() const
+{
+    if(!m_isEnd)
+        return false;
+
+    return (!m_videoCodecContext || m_videoWorker->isDrained()) &&
+           (!m_audioCodecContext || m_audioWorker->isDrained());
+}
+
 void FFmpegDecoder::decode()
 {
     AVPacket *packet = av_packet_alloc();
 
-    m_isDecoding = true;
-    while(m_state == Opened && m_runnable && this->shouldDecode())
+    // Interrupted by the last FFmpegDecoder::requestInterrupt()
+    if(m_runnable)
+        m_networkInput->resume();
+
+    // The interrupted read has left the input at the end and the demuxer amid a packet,
+    // demux again from the key frame before the last packet
+    if(m_runnable && m_isReadInterrupted)
     {
-        m_isEnd = av_read_frame(m_formatContext, packet);
-        if(m_isEnd)
+        m_isReadInterrupted = false;
+        av_seek_frame(m_formatContext, -1, m_lastPacketTime != AV_NOPTS_VALUE ? m_lastPacketTime : 0,
+                      AVSEEK_FLAG_BACKWARD);
+    }
+
+    m_isDemuxing.storeRelease(1);
+    while(m_state == Opened && m_runnable && !m_isEnd && this->shouldDemux())
+    {
+        TRACE_SCOPE("demux");
+
+        const int ret = av_read_frame(m_formatContext, packet);
+
+        // Not the end, the read is resumed by the next call
+        if(ret == AVERROR_EXIT && !m_runnable)
+        {
+            m_isReadInterrupted = true;
             break;
+        }
+
+        if((m_isEnd = ret < 0))
+        {
+            // Tell the decode workers to drain the codecs
+            if(m_videoStream)
+                m_videoPackets.putEnd();
+            if(m_audioStream)
+                m_audioPackets.putEnd();
+
+            break;
+        }
+
+        const qint64 timestamp = packet->dts != AV_NOPTS_VALUE ? packet->dts : packet->pts;
+        if(timestamp != AV_NOPTS_VALUE)
+            m_lastPacketTime = av_rescale_q(timestamp, m_formatContext->streams[packet->stream_index]->time_base,
+                                            AV_TIME_BASE_Q);
 
-        // Video frame decode
         if(m_videoStream && packet->stream_index == m_videoStream->index)
-            this->decodeVideo(packet);
+            m_videoPackets.put(packet);
 
-        // Audio frame decode
         else if(m_audioStream && packet->stream_index == m_audioStream->index)
-                this->decodeAudio(packet);
+            m_audioPackets.put(packet);
 
-        // Subtitle frame decode
         else if(m_subtitleStream && packet->stream_index == m_subtitleStream->index)
-            this->decodeSubtitle(packet);
+            m_subtitlePackets.put(packet);
 
         av_packet_unref(packet);
     }
 
-    m_isDecoding = false;
+    m_isDemuxing.storeRelease(0);
     av_packet_free(&packet);
 }
 
 void FFmpegDecoder::decodeVideo(AVPacket *packet)
 {
-    AVFrame *frame = av_frame_alloc();
-    if(avcodec_send_packet(m_videoCodecContext, packet) ||
-        avcodec_receive_frame(m_videoCodecContext, frame) ||
-        (!qIsNaN(m_fps) && second(frame->pts, m_videoStream->time_base) < m_seekTarget))
+    TRACE_SCOPE("decodeVideo");
+
+    const qint64 timestamp = packet->pts != AV_NOPTS_VALUE ? packet->pts : packet->dts;
+    const qreal time = timestamp != AV_NOPTS_VALUE ? second(timestamp, m_videoStream->time_base) : -1;
+
+    // Catching up with an accurate seek, the non-reference frames far enough before the target
+    // are not decoded at all, the ones next to it are kept since the target may be one of them
+    if(m_seekTarget >= 0 && !qIsNaN(m_fps) && time >= 0 && time < m_seekTarget)
     {
-        av_frame_free(&frame);
-        return;
-    }
+        const qreal margin = (m_videoCodecContext->has_b_frames + 1) / m_fps;
+        const AVDiscard discard = time < m_seekTarget - margin ? AVDISCARD_NONREF : AVDISCARD_DEFAULT;
 
-    // If subtitle filter is available
-    if(m_buffersrcContext && m_buffersinkContext)
+        // Not AVDISCARD_ALL for the loop filter, the reference frames must stay intact for the target
+        m_videoCodecContext->skip_frame = discard;
+        m_videoCodecContext->skip_loop_filter = discard;
+    }
+    else
     {
-        if(av_buffersrc_add_frame(m_buffersrcContext, frame) >= 0)
-            av_buffersink_get_frame(m_buffersinkContext, frame);
+        // Degrade when the presentation falls behind, see also FFmpegDecoder::setFrameDropLevel()
+        static const AVDiscard discards[] = { AVDISCARD_DEFAULT, AVDISCARD_NONREF, AVDISCARD_NONKEY };
+
+        m_videoCodecContext->skip_frame = discards[m_frameDropLevel.loadRelaxed()];
+        m_videoCodecContext->skip_loop_filter = AVDISCARD_DEFAULT;
     }
 
-    if(m_swsContext)
+    // The time in the codec, the frame threads decode while the packet is being sent
+    QElapsedTimer decodeTimer;
+    decodeTimer.start();
+
+    const int ret = avcodec_send_packet(m_videoCodecContext, packet);
+    m_decodeTime.fetchAndAddRelaxed(decodeTimer.nsecsElapsed());
+
+    if(ret < 0)
+        return;
+
+    AVFrame *frame = m_framePool.frame();
+    for(decodeTimer.restart(); avcodec_receive_frame(m_videoCodecContext, frame) == 0; decodeTimer.restart())
     {
-        AVFrame *swsFrame = av_frame_alloc();
-        swsFrame->pts = frame->pts;
-        swsFrame->width = frame->width;
-        swsFrame->height = frame->height;
-        swsFrame->format = AV_PIX_FMT_YUV420P;
+        m_decodeTime.fetchAndAddRelaxed(decodeTimer.nsecsElapsed());
 
-        sws_scale_frame(m_swsContext, swsFrame, frame);
-        av_frame_free(&frame);
+        // Dropped before the subtitle filter and the conversion
+        if(!qIsNaN(m_fps) && second(frame->pts, m_videoStream->time_base) < m_seekTarget)
+        {
+            av_frame_unref(frame);
+            continue;
+        }
 
-        frame = swsFrame;
-    }
+        // The frames not decoded on purpose leave gaps between the pts
+        if(m_videoCodecContext->skip_frame != AVDISCARD_DEFAULT && !qIsNaN(m_fps) &&
+            frame->pts != AV_NOPTS_VALUE && m_lastVideoPts != AV_NOPTS_VALUE)
+        {
+            const int gap = qRound(second(frame->pts - m_lastVideoPts, m_videoStream->time_base) * m_fps) - 1;
+            if(gap > 0)
+                m_skippedFrames.fetchAndAddRelaxed(gap);
+        }
+
+        if(frame->pts != AV_NOPTS_VALUE)
+            m_lastVideoPts = frame->pts;
+
+        this->updateVideoFormat(frame);
+
+        // If subtitle filter is available
+        if(m_buffersrcContext && m_buffersinkContext)
+        {
+            TRACE_SCOPE("subtitleFilter");
+
+            if(av_buffersrc_add_frame(m_buffersrcContext, frame) >= 0)
+                av_buffersink_get_frame(m_buffersinkContext, frame);
+        }
+
+        if(m_swsContext)
+        {
+            TRACE_SCOPE("sws");
+
+            AVFrame *swsFrame = m_framePool.videoFrame(AV_PIX_FMT_YUV420P,
+                                                       frame->width, frame->height);
+            if(!swsFrame)
+            {
+                av_frame_unref(frame);
+                continue;
+            }
+
+            av_frame_copy_props(swsFrame, frame);
+
+            QElapsedTimer timer;
+            timer.start();
+            sws_scale_frame(m_swsContext, swsFrame, frame);
+            m_scaleTime.fetchAndAddRelaxed(timer.nsecsElapsed());
+
+            m_framePool.recycle(frame);
+
+            frame = swsFrame;
+        }
 
-    frame->time_base = m_videoStream->time_base;
+        frame->time_base = m_videoStream->time_base;
 
-    QMutexLocker locker(&m_mutex);
-    m_videoCache.append(frame);
+        if(!this->waitForCache(m_videoCache))
+            break;
+
+        m_videoCache.push(frame, frameDuration(frame), frameBytes(frame));
+        m_decodedFrames.ref();
+
+        frame = m_framePool.frame();
+    }
+
+    m_framePool.recycle(frame);
 }
 
 void FFmpegDecoder::decodeAudio(AVPacket *packet)
 {
-    AVFrame *frame = av_frame_alloc();
-    if(avcodec_send_packet(m_audioCodecContext, packet) ||
-        avcodec_receive_frame(m_audioCodecContext, frame) ||
-        second(frame->pts, m_audioStream->time_base) < m_seekTarget)
-    {
-        av_frame_free(&frame);
+    TRACE_SCOPE("decodeAudio");
+
+    if(avcodec_send_packet(m_audioCodecContext, packet) < 0)
         return;
-    }
 
-    if(m_swrContext)
+    AVFrame *frame = m_framePool.frame();
+    while(avcodec_receive_frame(m_audioCodecContext, frame) == 0)
     {
-        AVFrame *swrFrame = av_frame_alloc();
-        swrFrame->pts = frame->pts;
-        swrFrame->nb_samples = frame->nb_samples;
-        swrFrame->format = AV_SAMPLE_FMT_S16;
-        av_channel_layout_default(&swrFrame->ch_layout, 2);
+        if(second(frame->pts, m_audioStream->time_base) < m_seekTarget)
+        {
+            av_frame_unref(frame);
+            continue;
+        }
 
-        av_frame_get_buffer(swrFrame, 0);
+        // Timed in samples, the duration stays the media one through the resampler and atempo
+        const AVRational sampleTimeBase{1, frame->sample_rate};
+        if(frame->pts != AV_NOPTS_VALUE)
+            frame->pts = av_rescale_q(frame->pts, m_audioStream->time_base, sampleTimeBase);
+        frame->duration = frame->nb_samples;
 
-        swr_convert(m_swrContext, swrFrame->data, frame->nb_samples,
-                    const_cast<const uint8_t **>(frame->data),
-                    frame->nb_samples);
+        if(m_swrContext)
+        {
+            TRACE_SCOPE("swr");
+
+            // Spread the compensation over this frame, the fraction is carried to the next one
+            const int ppm = m_audioCompensation.loadRelaxed();
+            if(ppm)
+            {
+                m_compensatedSamples += qreal(frame->nb_samples) * ppm / 1000000;
+
+                const int delta = int(m_compensatedSamples);
+                if(delta && swr_set_compensation(m_swrContext, delta, frame->nb_samples) >= 0)
+                    m_compensatedSamples -= delta;
+            }
+
+            AVChannelLayout stereo;
+            av_channel_layout_default(&stereo, 2);
+
+            const int outSamples = swr_get_out_samples(m_swrContext, frame->nb_samples);
+            AVFrame *swrFrame = outSamples > 0 ? m_framePool.audioFrame(AV_SAMPLE_FMT_S16, stereo,
+                                                                        outSamples) : nullptr;
+            if(!swrFrame)
+            {
+                av_frame_unref(frame);
+                continue;
+            }
+
+            av_frame_copy_props(swrFrame, frame);
+
+            QElapsedTimer timer;
+            timer.start();
+            const int samples = swr_convert(m_swrContext, swrFrame->data, outSamples,
+                                            const_cast<const uint8_t **>(frame->extended_data),
+                                            frame->nb_samples);
+            m_resampleTime.fetchAndAddRelaxed(timer.nsecsElapsed());
+
+            m_framePool.recycle(frame);
+            frame = swrFrame;
+
+            if(samples <= 0)
+            {
+                av_frame_unref(frame);
+                continue;
+            }
+
+            // The resampler could keep some samples for the next call
+            frame->nb_samples = samples;
+            frame->linesize[0] = av_samples_get_buffer_size(nullptr, 2, samples,
+                                                            AV_SAMPLE_FMT_S16, 1);
+        }
 
-        av_frame_free(&frame);
-        frame = swrFrame;
-    }
+        frame->time_base = sampleTimeBase;
 
-    frame->time_base = m_audioStream->time_base;
+        // Rebuild the time stretch for a new rate, the samples buffered in the old one are dropped
+        const int tempo = m_playbackRate.loadRelaxed();
+        if(tempo != m_tempo)
+        {
+            this->closeTempoFilter();
+            if(tempo != PLAYBACK_RATE_UNIT && m_swrContext)
+                this->openTempoFilter(tempo, frame->sample_rate);
+
+            m_tempo = tempo;
+        }
+
+        if(!m_tempoGraph)
+        {
+            if(!this->waitForCache(m_audioCache))
+                break;
+
+            m_audioCache.push(frame, frameDuration(frame), frameBytes(frame));
+            frame = m_framePool.frame();
+            continue;
+        }
 
-    QMutexLocker locker(&m_mutex);
-    m_audioCache.append(frame);
+        TRACE_SCOPE("atempo");
+
+        // Timed by the media consumed rather than the samples produced
+        if(m_tempoPosition < 0 && frame->pts != AV_NOPTS_VALUE)
+            m_tempoPosition = frame->pts;
+
+        int ret = 0;
+        if((ret = av_buffersrc_add_frame(m_tempoSource, frame)) < 0)
+        {
+            FFMPEG_ERROR(ret);
+            av_frame_unref(frame);
+            continue;
+        }
+
+        bool isInterrupted = false;
+        while(av_buffersink_get_frame(m_tempoSink, frame) >= 0)
+        {
+            const qreal duration = qreal(frame->nb_samples) * tempo / PLAYBACK_RATE_UNIT;
+
+            frame->time_base = sampleTimeBase;
+            frame->pts = m_tempoPosition < 0 ? AV_NOPTS_VALUE : qRound64(m_tempoPosition);
+            frame->duration = qRound64(duration);
+            frame->linesize[0] = av_samples_get_buffer_size(nullptr, 2, frame->nb_samples,
+                                                            AV_SAMPLE_FMT_S16, 1);
+
+            if(m_tempoPosition >= 0)
+                m_tempoPosition += duration;
+
+            if((isInterrupted = !this->waitForCache(m_audioCache)))
+                break;
+
+            m_audioCache.push(frame, frameDuration(frame), frameBytes(frame));
+            frame = m_framePool.frame();
+        }
+
+        if(isInterrupted)
+            break;
+    }
+
+    m_framePool.recycle(frame);
 }
 
 void FFmpegDecoder::decodeSubtitle(AVPacket *packet)
 {
+    TRACE_SCOPE("decodeSubtitle");
+
     int isGot = 0;
     AVSubtitle subtitle;
     auto cleanup = qScopeGuard([&] { avsubtitle_free(&subtitle); });
@@ -595,47 +1079,124 @@ void FFmpegDecoder::decodeSubtitle(AVPacket *packet)
 
     frame->start = second(packet->pts, m_subtitleStream->time_base);
 
-    QMutexLocker locker(&m_mutex);
-    m_subtitleCache.append(frame);
+    if(!this->waitForCache(m_subtitleCache))
+    {
+        delete frame;
+        return;
+    }
+
+    m_subtitleCache.push(frame, 0, frame->image.sizeInBytes());
 }
 
-bool FFmpegDecoder::shouldDecode() const
+bool FFmpegDecoder::shouldDemux() const
 {
-    QMutexLocker locker(&m_mutex);
-
-    if(m_videoCache.isFull() || m_audioCache.isFull() || m_subtitleCache.isFull())
+    if(m_videoPackets.size() + m_audioPackets.size() + m_subtitlePackets.size()
+        > m_packetQueueBytes)
         return false;
 
     bool enough = true;
 
     if(!qIsNaN(m_fps) && m_videoStream)
-        enough &= decodedDuration(m_videoCache) > MAX_DECODED_DURATION;
+        enough &= m_videoPackets.isFull();
     if(m_audioStream)
-        enough &= decodedDuration(m_audioCache) > MAX_DECODED_DURATION;
+        enough &= m_audioPackets.isFull();
 
     return !enough;
 }
 
-void FFmpegDecoder::clearCache()
+void FFmpegDecoder::requestDemux(const PacketQueue *queue)
 {
-    QMutexLocker locker(&m_mutex);
+    if(m_isEnd || (queue && queue->count() > queue->capacity() / 2))
+        return;
 
-    // Clear video cache
-    AVFrame *frame = nullptr;
-    while(!m_videoCache.isEmpty())
-    {
-        frame = m_videoCache.takeFirst();
-        av_frame_free(&frame);
-    }
+    // Asynchronous call FFmpegDecoder::decode()
+    if(m_isDemuxing.testAndSetOrdered(0, 1))
+        QMetaObject::invokeMethod(this, &FFmpegDecoder::decode, Qt::QueuedConnection);
+}
+
+void FFmpegDecoder::startWorkers()
+{
+    if(m_state != Opened)
+        return;
+
+    if(m_videoCodecContext)
+        m_videoWorker->launch();
+    if(m_audioCodecContext)
+        m_audioWorker->launch();
+    if(m_subtitleCodecContext)
+        m_subtitleWorker->launch();
+
+    this->requestDemux();
+}
+
+bool FFmpegDecoder::stopWorkers()
+{
+    const bool isRunning = m_videoWorker->isRunning() || m_audioWorker->isRunning() ||
+                           m_subtitleWorker->isRunning();
+
+    m_videoWorker->requestInterruption();
+    m_audioWorker->requestInterruption();
+    m_subtitleWorker->requestInterruption();
+
+    // Wake up the workers which are waiting for the cache
+    m_videoCache.wakeAll();
+    m_audioCache.wakeAll();
+    m_subtitleCache.wakeAll();
 
-    // Clear audio and subtitle cache
-    while(!m_audioCache.isEmpty())
+    m_videoWorker->stop();
+    m_audioWorker->stop();
+    m_subtitleWorker->stop();
+
+    return isRunning;
+}
+
+template <typename T>
+bool FFmpegDecoder::waitForCache(FrameQueue<T> &cache)
+{
+    const QThread *worker = QThread::currentThread();
+    while(!worker->isInterruptionRequested())
     {
-        frame = m_audioCache.takeFirst();
-        av_frame_free(&frame);
+        if(!isCacheFull(cache))
+            return true;
+
+        TRACE_SCOPE("waitForCache");
+        cache.waitWhile([&] {
+            return isCacheFull(cache) && !worker->isInterruptionRequested();
+        }, CACHE_WAIT_TIMEOUT);
     }
 
-    m_subtitleCache.clear();
+    return false;
+}
+
+bool FFmpegDecoder::isCacheFull(const FrameQueue<AVFrame *> &cache) const
+{
+    if(cache.isFull())
+        return true;
+
+    const qreal duration = cache.duration();
+    if(duration > this->lookAhead())
+        return true;
+
+    // The budget is shared by all caches
+    return duration > MIN_CACHED_DURATION && this->residentBytes() > this->cacheBudget();
+}
+
+bool FFmpegDecoder::isCacheFull(const FrameQueue<SubtitleFrame *> &cache) const
+{
+    return cache.isFull();
+}
+
+void FFmpegDecoder::clearCache()
+{
+    // The frames are released by the consumer of FFmpegDecoder::take*Frame()
+    m_videoCache.invalidate();
+    m_audioCache.invalidate();
+    m_subtitleCache.invalidate();
+
+    // Clear packet queues
+    m_videoPackets.clear();
+    m_audioPackets.clear();
+    m_subtitlePackets.clear();
 }
 
 bool FFmpegDecoder::openCodecContext(AVStream *&stream, AVCodecContext *&codecContext,
@@ -667,7 +1228,28 @@ bool FFmpegDecoder::openCodecContext(AVStream *&stream, AVCodecContext *&codecCo
         return false;
     }
 
-    codecContext->thread_count = 1;
+    if(type == AVMEDIA_TYPE_VIDEO)
+    {
+        codecContext->thread_count = m_threadCount;
+
+        switch(m_threadingMode)
+        {
+        case NoThreading:
+            codecContext->thread_count = 1;
+            break;
+        case FrameThreading:
+            codecContext->thread_type = FF_THREAD_FRAME;
+            break;
+        case SliceThreading:
+            codecContext->thread_type = FF_THREAD_SLICE;
+            break;
+        default:
+            codecContext->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+            break;
+        }
+    }
+    else
+        codecContext->thread_count = 1;
 
     AVDictionary *opts = nullptr;
     if ((ret = avcodec_parameters_to_context(codecContext, stream->codecpar)) < 0)
@@ -698,6 +1280,85 @@ void FFmpegDecoder::closeCodecContext(AVStream *&stream, AVCodecContext *&codecC
     stream = nullptr;
 }
 
+void FFmpegDecoder::updateVideoFormat(const AVFrame *frame)
+{
+    if(frame->format == m_videoFormat)
+        return;
+
+    m_videoFormat = static_cast<AVPixelFormat>(frame->format);
+
+    // Convert to supported format if not
+    if(isNativeFormat(m_videoFormat))
+    {
+        sws_freeContext(m_swsContext);
+        m_swsContext = nullptr;
+    }
+    else
+        m_swsContext = sws_getCachedContext(m_swsContext, frame->width, frame->height, m_videoFormat,
+                                            frame->width, frame->height, AV_PIX_FMT_YUV420P,
+                                            SWS_BICUBIC, nullptr, nullptr, nullptr);
+
+    m_isVideoConverted.storeRelaxed(m_swsContext != nullptr);
+
+    if(m_isSubtitleFilterPending)
+    {
+        m_isSubtitleFilterPending = false;
+
+        if(!this->openSubtitleFilter(this->subtitleFilterArgs(m_videoFormat),
+                                     this->subtitleFilterDesc(m_subtitleIndex)))
+            FUNC_ERROR << "Failed to open the subtitle filter";
+    }
+}
+
+QString FFmpegDecoder::subtitleFilterArgs(int pixelFormat) const
+{
+    const AVRational timeBase = m_videoStream->time_base;
+    const AVRational pixelAspect = m_videoCodecContext->sample_aspect_ratio;
+
+    return QString::asprintf(
+        "video_size=%dx%d:pix_fmt=%d:time_base=%d/%d:pixel_aspect=%d/%d",
+        m_videoCodecContext->width, m_videoCodecContext->height,
+        pixelFormat, timeBase.num, timeBase.den,
+        pixelAspect.num, pixelAspect.den);
+}
+
+QString FFmpegDecoder::subtitleFilterDesc(int index) const
+{
+    auto convertPath = [](QString fileName) -> QString {
+#ifdef Q_OS_WIN
+        fileName.replace('/', "\\\\");
+        return fileName.insert(fileName.indexOf(":\\"), char('\\'));
+#else
+        return fileName;
+#endif
+    };
+
+    QString fileName;
+    int relativeIndex = 0;
+
+    if(m_subtitleIndexes[index].type() == QVariant::Int)            // Embedded subtitle
+    {
+        // Rendered from the file, the bitmap ones are decoded instead
+        const AVCodecDescriptor *descriptor = avcodec_descriptor_get(
+            m_formatContext->streams[m_subtitleIndexes[index].toInt()]->codecpar->codec_id);
+        if(!m_url.isLocalFile() || (descriptor && descriptor->props & AV_CODEC_PROP_BITMAP_SUB))
+            return {};
+
+        fileName = m_url.toLocalFile();
+        relativeIndex = index;
+    }
+    else if(m_subtitleIndexes[index].type() == QVariant::String)    // External subtitles
+        fileName = m_subtitleIndexes[index].toString();
+    else
+        return {};
+
+    return QString("subtitles=filename='%1':original_size=%2x%3:si=%4")
+        .arg(convertPath(fileName))
+        .arg(m_videoCodecContext->width)
+        .arg(m_videoCodecContext->height)
+        .arg(relativeIndex);
+}
+
 bool FFmpegDecoder::openSubtitleFilter(const QString& args, const QString& filterDesc)
 {
     const AVFilter *buffersrc = avfilter_get_by_name("buffer");
@@ -781,6 +1442,83 @@ void FFmpegDecoder::closeSubtitleFilter()
     m_buffersinkContext = nullptr;
 }
 
+bool FFmpegDecoder::openTempoFilter(int tempo, int sampleRate)
+{
+    // Chained for the rates out of [0.5, 2], atempo is limited to it before FFmpeg 4.3
+    QStringList filters;
+    qreal factor = qreal(tempo) / PLAYBACK_RATE_UNIT;
+    for(; factor > 2; factor /= 2)
+        filters << "atempo=2";
+    for(; factor < 0.5; factor *= 2)
+        filters << "atempo=0.5";
+    filters << "atempo=" + QString::number(factor);
+
+    // Same as the output of the resampler
+    filters << "aformat=sample_fmts=s16:channel_layouts=stereo";
+
+    const QString args = QString::asprintf(
+        "time_base=1/%d:sample_rate=%d:sample_fmt=s16:channel_layout=stereo", sampleRate, sampleRate);
+
+    AVFilterInOut *output = avfilter_inout_alloc();
+    AVFilterInOut *input = avfilter_inout_alloc();
+    m_tempoGraph = avfilter_graph_alloc();
+
+    auto cleanup = qScopeGuard([&output, &input] {
+        avfilter_inout_free(&output);
+        avfilter_inout_free(&input);
+    });
+
+    if(!output || !input || !m_tempoGraph)
+    {
+        this->closeTempoFilter();
+        return false;
+    }
+
+    int ret = 0;
+    if((ret = avfilter_graph_create_filter(&m_tempoSource, avfilter_get_by_name("abuffer"), "in",
+                                            args.toUtf8().data(), nullptr, m_tempoGraph)) < 0 ||
+        (ret = avfilter_graph_create_filter(&m_tempoSink, avfilter_get_by_name("abuffersink"), "out",
+                                            nullptr, nullptr, m_tempoGraph)) < 0)
+    {
+        FFMPEG_ERROR(ret);
+        this->closeTempoFilter();
+        return false;
+    }
+
+    output->name = av_strdup("in");
+    output->next = nullptr;
+    output->pad_idx = 0;
+    output->filter_ctx = m_tempoSource;
+
+    input->name = av_strdup("out");
+    input->next = nullptr;
+    input->pad_idx = 0;
+    input->filter_ctx = m_tempoSink;
+
+    if((ret = avfilter_graph_parse_ptr(m_tempoGraph, filters.join(',').toUtf8().data(),
+                                        &input, &output, nullptr)) < 0 ||
+        (ret = avfilter_graph_config(m_tempoGraph, nullptr)) < 0)
+    {
+        FFMPEG_ERROR(ret);
+        this->closeTempoFilter();
+        return false;
+    }
+
+    return true;
+}
+
+void FFmpegDecoder::closeTempoFilter()
+{
+    // The filters are freed along with the graph
+    avfilter_graph_free(&m_tempoGraph);
+
+    m_tempoSource = nullptr;
+    m_tempoSink = nullptr;
+
+    m_tempo = PLAYBACK_RATE_UNIT;
+    m_tempoPosition = -1;
+}
+
 static void mergeSubtitle(uint8_t *dst, int dst_linesize, int w, int h,
                                   AVSubtitleRect *r)
 {
@@ -840,10 +1578,57 @@ inline static qreal second(const qint64 pts, const AVRational timebase)
     return static_cast<qreal>(pts) * av_q2d(timebase);
 }
 
-inline static qreal decodedDuration(const QContiguousCache<AVFrame *> &cache)
+static bool isNativeFormat(int format)
 {
-    if(cache.isEmpty())
-        return 0;
+    switch(format)
+    {
+    case AV_PIX_FMT_YUV420P:
+    case AV_PIX_FMT_YUVJ420P:
+    case AV_PIX_FMT_YUV422P:
+    case AV_PIX_FMT_YUVJ422P:
+    case AV_PIX_FMT_YUV444P:
+    case AV_PIX_FMT_YUVJ444P:
+    case AV_PIX_FMT_YUV420P10LE:
+    case AV_PIX_FMT_YUV422P10LE:
+    case AV_PIX_FMT_YUV444P10LE:
+    case AV_PIX_FMT_YUV420P12LE:
+    case AV_PIX_FMT_YUV422P12LE:
+    case AV_PIX_FMT_YUV444P12LE:
+    case AV_PIX_FMT_NV12:
+    case AV_PIX_FMT_NV21:
+    case AV_PIX_FMT_P010LE:
+    case AV_PIX_FMT_RGB24:
+    case AV_PIX_FMT_BGR24:
+    case AV_PIX_FMT_RGBA:
+    case AV_PIX_FMT_RGB0:
+    case AV_PIX_FMT_BGRA:
+    case AV_PIX_FMT_BGR0:
+        return true;
+    default:
+        return false;
+    }
+}
 
-    return FFmpegDecoder::framePts(cache.last()) - FFmpegDecoder::framePts(cache.first());
+static bool hasCodecParameters(const AVFormatContext *format)
+{
+    for(unsigned i = 0; i < format->nb_streams; ++i)
+    {
+        const AVStream *stream = format->streams[i];
+        const AVCodecParameters *par = stream->codecpar;
+
+        // Cover arts have no frame rate
+        if(stream->disposition & AV_DISPOSITION_ATTACHED_PIC)
+            continue;
+
+        if(par->codec_type == AVMEDIA_TYPE_VIDEO &&
+            (par->codec_id == AV_CODEC_ID_NONE || par->width <= 0 || par->height <= 0 ||
+             stream->avg_frame_rate.num <= 0 || stream->avg_frame_rate.den <= 0))
+            return false;
+
+        if(par->codec_type == AVMEDIA_TYPE_AUDIO &&
+            (par->codec_id == AV_CODEC_ID_NONE || par->sample_rate <= 0 || par->ch_layout.nb_channels <= 0))
+            return false;
+    }
+
+    return true;
 }
@@ -10,16 +10,21 @@
 #include <QUrl>
 #include <QSize>
 #include <QDebug>
-#include <QMutex>
 #include <QImage>
 #include <QObject>
 #include <QVariant>
+#include <QAtomicInt>
 #include <QAudioFormat>
 #include <QSharedPointer>
-#include <QContiguousCache>
 
 #include <ffmpeg.h>
 
+#include "config.h"
+#include "framepool.h"
+#include "framequeue.h"
+#include "packetqueue.h"
+#include "playerconfig.h"
+
 #define FUNC_ERROR qCritical() << __FUNCTION__
 
 struct SubtitleFrame
@@ -32,6 +37,11 @@ struct SubtitleFrame
     qreal start = 0;
 };
 
+class DecodeWorker;
+class KeyframeIndex;
+class MappedFileIO;
+class NetworkInput;
+
 class FFmpegDecoder final : public QObject
 {
     Q_OBJECT
@@ -39,23 +49,85 @@ public:
     enum State
     {
         Opened,
-        Closed
+        Closed,
+        Loading         // Opening the input and probing the streams, see also FFmpegDecoder::tracksFound()
     };
     Q_ENUM(State)
 
+    enum ThreadingMode
+    {
+        NoThreading,
+        AutoThreading,          // Let the codec pick frame and/or slice threading
+        FrameThreading,
+        SliceThreading
+    };
+    Q_ENUM(ThreadingMode)
+
+    // Frames not decoded to keep up with the playback, by AVCodecContext::skip_frame
+    enum FrameDropLevel
+    {
+        NoFrameDrop,
+        DropNonReference,
+        DropNonKey
+    };
+
     explicit FFmpegDecoder(QObject *parent = nullptr);
     ~FFmpegDecoder() Q_DECL_OVERRIDE;
 
     /**
-     * @brief Request the interruption of the FFmpegDecoer::decode
+     * @brief Request the interruption of the FFmpegDecoer::decode (demuxing),
+     *        the decode workers keep running until they are stopped by the slots.
+     *        A read waiting for the network input returns too.
      */
-    void requestInterrupt() { m_runnable = false; }
+    void requestInterrupt();
+
+    /**
+     * @brief Queue FFmpegDecoder::load(), it is aborted by an FFmpegDecoder::requestInterrupt()
+     *        also before it has started
+     */
+    void requestLoad();
 
     void setUrl(const QUrl& url) { m_url = url; }
     QUrl url() const { return m_url; }
 
     State state() const { return m_state; }
 
+    /**
+     * @brief Asynchronous seek, only the latest request of a burst is performed,
+     *        FFmpegDecoder::seeked() is emitted when it is done. It could be called by any thread.
+     * @param isAccurate drop the frames before the position, otherwise start from the key frame
+     *        before it. It is ignored if the seek mode of PlayerConfig is KeyFrameSeek.
+     * @return serial of the request, FFmpegDecoder::seeked() carries the one performed
+     */
+    int requestSeek(int position, bool isAccurate);
+
+    /**
+     * @brief Apply the configuration, it must be called while the decoder is closed
+     */
+    void setConfig(const PlayerConfig *config);
+
+    /**
+     * @return threading mode which is actually used by the active video codec,
+     *         it could be called by any thread
+     */
+    ThreadingMode activeThreadingMode() const
+    { return static_cast<ThreadingMode>(m_activeThreadingMode.loadRelaxed()); }
+
+    /**
+     * @return memory shared by the frame caches, in bytes
+     */
+    qint64 cacheBudget() const { return m_cacheBudget; }
+
+    /**
+     * @return duration the decode workers keep decoded ahead, in seconds
+     */
+    qreal lookAhead() const { return m_lookAhead; }
+
+    /**
+     * @return memory held by the cached frames now, in bytes
+     */
+    qint64 residentBytes() const;
+
     QString errorString() const { return m_errorBuf; }
 
     int activeVideoTrack() const;
@@ -70,19 +142,92 @@ public:
 
     bool seekable() const;
 
-    bool isEnd() const { return m_isEnd; }
+    /**
+     * @return true if the demuxer has reached the end and all decode workers have been drained
+     */
+    bool isEnd() const;
 
     /**
-     * @return duration of the media in seconds.
+     * @return duration of the media in seconds, 0 if unknown or not seekable.
+     *         It is valid since FFmpegDecoder::tracksFound().
      */
     int duration() const;
 
     const QAudioFormat audioFormat() const;
 
+    /**
+     * @brief Stretch the decoded audio by the ratio through the resampler, positive to add samples,
+     *        so the drift of the audio device could be absorbed. Thread safe.
+     */
+    void setAudioCompensation(qreal ratio) { m_audioCompensation.storeRelaxed(qRound(ratio * 1000000)); }
+
+    /**
+     * @brief Time stretch the decoded audio by atempo keeping the pitch, the stretched frames
+     *        are timed in the media so their duration is longer or shorter than the samples.
+     *        Thread safe, it takes effect from the next decoded frame.
+     */
+    void setPlaybackRate(qreal rate) { m_playbackRate.storeRelaxed(qRound(rate * PLAYBACK_RATE_UNIT)); }
+
+    /**
+     * @brief Thread safe, it takes effect from the next packet except while catching up with a seek
+     */
+    void setFrameDropLevel(FrameDropLevel level) { m_frameDropLevel.storeRelaxed(level); }
+
+    /**
+     * @return count of the frames not decoded by the frame drop level since the media was loaded
+     */
+    int skippedFrames() const { return m_skippedFrames.loadRelaxed(); }
+
+    /**
+     * @return time spent in sws and swr converting the decoded frames since the media was loaded,
+     *         in nanoseconds
+     */
+    qint64 scaleTime() const { return m_scaleTime.loadRelaxed(); }
+    qint64 resampleTime() const { return m_resampleTime.loadRelaxed(); }
+
+    /**
+     * @return count of the video frames put into the cache since the media was loaded
+     */
+    int decodedFrames() const { return m_decodedFrames.loadRelaxed(); }
+
+    /**
+     * @return time spent in the video codec since the media was loaded, in nanoseconds
+     */
+    qint64 decodeTime() const { return m_decodeTime.loadRelaxed(); }
+
+    /**
+     * @return true if the video frames are converted by sws rather than uploaded as decoded,
+     *         it could be called by any thread
+     */
+    bool isVideoConverted() const { return m_isVideoConverted.loadRelaxed(); }
+
+    /**
+     * @brief The caches are only read through it, see also FrameQueue::count(),
+     *        FrameQueue::duration() and FrameQueue::bytes()
+     */
+    const FrameQueue<AVFrame *> &videoCache() const { return m_videoCache; }
+    const FrameQueue<AVFrame *> &audioCache() const { return m_audioCache; }
+
+    /**
+     * @brief The network streams are read ahead by it, see also NetworkInput::isOpen()
+     */
+    const NetworkInput *networkInput() const { return m_networkInput; }
+
     AVFrame *takeVideoFrame();
     AVFrame *takeAudioFrame();
     SubtitleFrame *takeSubtitleFrame(qreal time);
 
+    /**
+     * @brief Release the cached frames, it should be called by the consumer
+     *        of FFmpegDecoder::take*Frame() after the decoder has been closed
+     */
+    void clearFrames();
+
+    /**
+     * @brief The frames taken from FFmpegDecoder should be given back to FramePool::recycle()
+     */
+    FramePool *framePool() { return &m_framePool; }
+
     /**
      * @return qQNaN() if not available(eg. no video frames or only a single frame like album cover),
      *         otherwise returns frame rate of video stream
@@ -91,32 +236,79 @@ public:
 
     static qreal framePts(const AVFrame *frame);
     static qreal frameDuration(const AVFrame *frame);
+    static qint64 frameBytes(const AVFrame *frame);
 
 signals:
     void stateChanged(FFmpegDecoder::State);
 
+    /**
+     * @brief The tracks and the duration are known, emitted while loading once the header
+     *        is parsed, or after probing the formats without a header. They are not changed
+     *        until the decoder is released.
+     */
+    void tracksFound();
+
     void activeVideoTrackChanged(int);
     void activeAudioTrackChanged(int);
     void activeSubtitleTrackChanged(int);
 
+    void seeked(int position, int serial);
+
 public slots:
     void load();
     void release();
 
-    void seek(int position);
-
     void setActiveVideoTrack(int index);
     void setActiveAudioTrack(int index);
     void setActiveSubtitleTrack(int index);
 
+    /**
+     * @brief Demux packets into the per-stream packet queues,
+     *        which are drained by the decode workers
+     */
     void decode();
 
 private:
+    /**
+     * @brief Find the tracks including the external subtitles, then emit FFmpegDecoder::tracksFound()
+     */
+    void findTracks(const QString &url);
+
+    /**
+     * @brief AVIOInterruptCB of the loading format context
+     */
+    static int isLoadInterrupted(void *opaque);
+
+    void processSeek();
+    void seek(int position, bool isAccurate);
+
     void decodeVideo(AVPacket *packet);
     void decodeAudio(AVPacket *packet);
     void decodeSubtitle(AVPacket *packet);
 
-    bool shouldDecode() const;
+    bool shouldDemux() const;
+
+    /**
+     * @brief Asynchronous call FFmpegDecoder::decode() if the queue is running low
+     */
+    void requestDemux(const PacketQueue *queue = nullptr);
+
+    void startWorkers();
+
+    /**
+     * @return true if any decode worker was running
+     */
+    bool stopWorkers();
+
+    /**
+     * @brief Block the decode worker while the cache has no room for a new frame
+     * @return false if the worker has been requested to stop
+     */
+    template <typename T>
+    bool waitForCache(FrameQueue<T> &cache);
+
+    bool isCacheFull(const FrameQueue<AVFrame *> &cache) const;
+    bool isCacheFull(const FrameQueue<SubtitleFrame *> &cache) const;
 
     void clearCache();
 
@@ -124,16 +316,30 @@ private:
                           AVMediaType type, int index);
     void closeCodecContext(AVStream *&stream, AVCodecContext *&codecContext);
 
+    /**
+     * @brief Choose the conversion by the format of the decoded frames, and open the subtitle
+     *        filter waiting for it, called by the video worker
+     */
+    void updateVideoFormat(const AVFrame *frame);
+
+    QString subtitleFilterArgs(int pixelFormat) const;
+
+    /**
+     * @return empty if the subtitle track is not rendered by the filter
+     */
+    QString subtitleFilterDesc(int index) const;
+
     bool openSubtitleFilter(const QString &args, const QString &filterDesc);
     void closeSubtitleFilter();
 
+    bool openTempoFilter(int tempo, int sampleRate);
+    void closeTempoFilter();
+
 private:
     State m_state = Closed;
 
     char m_errorBuf[AV_ERROR_MAX_STRING_SIZE];
 
-    mutable QMutex m_mutex;
-
     QUrl m_url;
 
     AVFormatContext *m_formatContext = nullptr;
@@ -151,25 +357,93 @@ private:
     AVFilterContext *m_buffersrcContext  = nullptr;
     AVFilterContext *m_buffersinkContext = nullptr;
 
+    // Time stretch after the resampler, see also FFmpegDecoder::setPlaybackRate()
+    AVFilterGraph *m_tempoGraph = nullptr;
+    AVFilterContext *m_tempoSource = nullptr;
+    AVFilterContext *m_tempoSink = nullptr;
+
     SwrContext *m_swrContext = nullptr;
     SwsContext *m_swsContext = nullptr;
 
-    QContiguousCache<AVFrame *> m_videoCache;
-    QContiguousCache<AVFrame *> m_audioCache;
-    QContiguousCache<SubtitleFrame *> m_subtitleCache;
+    FramePool m_framePool;
+
+    // Produced by the decode workers, consumed by FFmpegDecoder::take*Frame()
+    FrameQueue<AVFrame *> m_videoCache;
+    FrameQueue<AVFrame *> m_audioCache;
+    FrameQueue<SubtitleFrame *> m_subtitleCache;
+
+    PacketQueue m_videoPackets;
+    PacketQueue m_audioPackets;
+    PacketQueue m_subtitlePackets;
+
+    DecodeWorker *m_videoWorker = nullptr;
+    DecodeWorker *m_audioWorker = nullptr;
+    DecodeWorker *m_subtitleWorker = nullptr;
+
+    KeyframeIndex *m_keyframeIndex = nullptr;
+
+    MappedFileIO *m_mappedFile = nullptr;           // Input of the local files if mapped
+    bool m_isMappingFiles = true;
+
+    NetworkInput *m_networkInput = nullptr;         // Input of the network streams if buffered
+    qint64 m_networkBufferSize = 0;
+    qreal m_networkReadAhead = 0;
+    qint64 m_diskCacheSize = 0;
+
+    qreal m_probeDuration = 0;                      // See also PlayerConfig::probeDuration
+    QAtomicInt m_duration;                          // See also FFmpegDecoder::duration()
 
     qreal m_fps = qQNaN();                          // See also FFmpegDecoder::fps()
 
-    volatile bool m_isDecoding = false;
+    // See also PlayerConfig
+    ThreadingMode m_threadingMode = AutoThreading;
+    int m_threadCount = 0;
+    qint64 m_cacheBudget;
+    qreal m_lookAhead;
+    qint64 m_packetQueueBytes;
+    bool m_isAccurateSeek = true;
+
+    QAtomicInt m_isDemuxing;                        // Is FFmpegDecoder::decode() running or queued
     volatile bool m_runnable = false;               // Is FFmpegDecoder::decode() could run
+    QAtomicInt m_interruptSerial;                   // Increased by FFmpegDecoder::requestInterrupt()
+    QAtomicInt m_loadSerial;                        // Of the interrupts when the load was requested
     volatile bool m_isEnd = false;
+    bool m_isReadInterrupted = false;               // The demuxer was left amid a packet, see also FFmpegDecoder::decode()
+    qint64 m_lastPacketTime = AV_NOPTS_VALUE;       // Of the last demuxed packet, in AV_TIME_BASE
 
     int m_seekTarget = -1;                          // -1 means undefined
 
+    QAtomicInteger<qint64> m_seekRequest{-1};      // serial << 32 | position << 1 | isAccurate, -1 means none
+    QAtomicInt m_seekSerial;                        // Of the latest request
+    QAtomicInt m_isSeekQueued;                      // Is FFmpegDecoder::processSeek() queued
+
+    QAtomicInt m_audioCompensation;                 // In parts per million
+
+    QAtomicInt m_playbackRate{PLAYBACK_RATE_UNIT};
+    int m_tempo = PLAYBACK_RATE_UNIT;               // Of m_tempoGraph
+    qreal m_tempoPosition = -1;                     // Media time of the next stretched sample, in samples
+
+    QAtomicInt m_frameDropLevel;                    // FrameDropLevel
+    QAtomicInt m_skippedFrames;
+    qint64 m_lastVideoPts = AV_NOPTS_VALUE;         // Of the last decoded frame, to find the gaps
+    qreal m_compensatedSamples = 0;                 // Fraction not applied yet
+
+    QAtomicInteger<qint64> m_scaleTime{0};
+    QAtomicInteger<qint64> m_resampleTime{0};
+
+    QAtomicInt m_decodedFrames;
+    QAtomicInteger<qint64> m_decodeTime{0};
+
+    // Of the active video codec, stored on opening it and on its first frame as the GUI thread reads them
+    QAtomicInt m_activeThreadingMode{NoThreading};
+    QAtomicInt m_isVideoConverted;
+    AVPixelFormat m_videoFormat = AV_PIX_FMT_NONE;  // Of the decoded frames, the conversion is chosen by it
+
     QList<int> m_videoIndexes;
     QList<int> m_audioIndexes;
     QList<QVariant> m_subtitleIndexes;
     int m_subtitleIndex = -1;
+    bool m_isSubtitleFilterPending = false;         // Opened on the first video frame
 };
 
 #endif // FFMPEGDECODER_H
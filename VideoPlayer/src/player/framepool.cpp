@@ -0,0 +1,213 @@
+/**
+ * @brief Frame Pool
+ * @anchor Ho 229
+ * @date 2023/5/10
+ */
+
+#include "config.h"
+#include "framepool.h"
+
+#include <QtMath>
+#include <QMutexLocker>
+
+// Alignment of the pooled video lines, in bytes
+#define LINESIZE_ALIGN 64
+
+// Extra bytes at the end of every pooled plane for SIMD over-reads
+#define PLANE_PADDING 64
+
+inline static quint64 poolKey(AVMediaType type, int format, int width, int height)
+{
+    return (quint64(type & 0xF) << 60) | (quint64(format & 0xFFF) << 48) |
+           (quint64(width & 0xFFFFFF) << 24) | quint64(height & 0xFFFFFF);
+}
+
+FramePool::~FramePool()
+{
+    this->clear();
+
+    for(AVFrame *frame : qAsConst(m_frames))
+        av_frame_free(&frame);
+}
+
+AVFrame *FramePool::frame()
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        if(!m_frames.isEmpty())
+            return m_frames.takeLast();
+    }
+
+    return av_frame_alloc();
+}
+
+AVFrame *FramePool::videoFrame(AVPixelFormat format, int width, int height)
+{
+    AVFrame *frame = this->frame();
+    if(!frame)
+        return nullptr;
+
+    frame->format = format;
+    frame->width = width;
+    frame->height = height;
+
+    QMutexLocker locker(&m_mutex);
+
+    const BufferPool *pool = this->videoPool(format, width, height);
+    for(int i = 0; pool && i < pool->planeCount; ++i)
+    {
+        if(!(frame->buf[i] = av_buffer_pool_get(pool->planes[i])))
+        {
+            pool = nullptr;
+            break;
+        }
+
+        frame->data[i] = frame->buf[i]->data;
+        frame->linesize[i] = pool->linesizes[i];
+    }
+
+    locker.unlock();
+
+    if(!pool)
+    {
+        av_frame_free(&frame);
+        return nullptr;
+    }
+
+    frame->extended_data = frame->data;
+    return frame;
+}
+
+AVFrame *FramePool::audioFrame(AVSampleFormat format, const AVChannelLayout &layout, int samples)
+{
+    AVFrame *frame = this->frame();
+    if(!frame)
+        return nullptr;
+
+    frame->format = format;
+    frame->nb_samples = samples;
+
+    const int channels = layout.nb_channels;
+    if(av_channel_layout_copy(&frame->ch_layout, &layout) < 0 ||
+        (av_sample_fmt_is_planar(format) && channels > AV_NUM_DATA_POINTERS))
+    {
+        // Not poolable, fallback to av_frame_get_buffer()
+        if(av_frame_get_buffer(frame, 0) < 0)
+            av_frame_free(&frame);
+
+        return frame;
+    }
+
+    QMutexLocker locker(&m_mutex);
+
+    const BufferPool *pool = this->audioPool(format, channels, samples);
+    if(pool)
+        frame->buf[0] = av_buffer_pool_get(pool->planes[0]);
+
+    locker.unlock();
+
+    if(!frame->buf[0])
+    {
+        av_frame_free(&frame);
+        return nullptr;
+    }
+
+    // Tightly packed, so linesize[0] is exactly the size of the samples (per plane)
+    av_samples_fill_arrays(frame->data, frame->linesize, frame->buf[0]->data,
+                           channels, samples, format, 1);
+    frame->extended_data = frame->data;
+
+    return frame;
+}
+
+void FramePool::recycle(AVFrame *frame)
+{
+    if(!frame)
+        return;
+
+    av_frame_unref(frame);
+
+    {
+        QMutexLocker locker(&m_mutex);
+        if(m_frames.size() < FRAME_POOL_SIZE)
+        {
+            m_frames.append(frame);
+            return;
+        }
+    }
+
+    av_frame_free(&frame);
+}
+
+void FramePool::clear()
+{
+    QMutexLocker locker(&m_mutex);
+
+    for(auto &pool : m_pools)
+        releasePool(pool);
+
+    m_pools.clear();
+}
+
+FramePool::BufferPool *FramePool::videoPool(AVPixelFormat format, int width, int height)
+{
+    const quint64 key = poolKey(AVMEDIA_TYPE_VIDEO, format, width, height);
+
+    auto it = m_pools.find(key);
+    if(it != m_pools.end())
+        return &it.value();
+
+    BufferPool pool;
+    if(av_image_fill_linesizes(pool.linesizes, format, width) < 0)
+        return nullptr;
+
+    ptrdiff_t linesizes[4];
+    for(int i = 0; i < 4; ++i)
+        linesizes[i] = pool.linesizes[i] = FFALIGN(pool.linesizes[i], LINESIZE_ALIGN);
+
+    size_t sizes[4];
+    if(av_image_fill_plane_sizes(sizes, format, height, linesizes) < 0)
+        return nullptr;
+
+    for(; pool.planeCount < 4 && sizes[pool.planeCount]; ++pool.planeCount)
+    {
+        AVBufferPool *&plane = pool.planes[pool.planeCount];
+        if(!(plane = av_buffer_pool_init(sizes[pool.planeCount] + PLANE_PADDING, nullptr)))
+        {
+            releasePool(pool);
+            return nullptr;
+        }
+    }
+
+    return &m_pools.insert(key, pool).value();
+}
+
+FramePool::BufferPool *FramePool::audioPool(AVSampleFormat format, int channels, int samples)
+{
+    // Frames of variable length share the pool of the next power of two
+    const int capacity = int(qNextPowerOfTwo(quint32(qMax(1, samples) - 1)));
+    const quint64 key = poolKey(AVMEDIA_TYPE_AUDIO, format, capacity, channels);
+
+    auto it = m_pools.find(key);
+    if(it != m_pools.end())
+        return &it.value();
+
+    const int size = av_samples_get_buffer_size(nullptr, channels, capacity, format, 1);
+    if(size < 0)
+        return nullptr;
+
+    BufferPool pool;
+    if(!(pool.planes[0] = av_buffer_pool_init(size_t(size) + PLANE_PADDING, nullptr)))
+        return nullptr;
+
+    pool.planeCount = 1;
+    return &m_pools.insert(key, pool).value();
+}
+
+void FramePool::releasePool(BufferPool &pool)
+{
+    for(int i = 0; i < pool.planeCount; ++i)
+        av_buffer_pool_uninit(&pool.planes[i]);
+
+    pool.planeCount = 0;
+}
@@ -0,0 +1,71 @@
+/**
+ * @brief Frame Pool
+ * @anchor Ho 229
+ * @date 2023/5/10
+ */
+
+#ifndef FRAMEPOOL_H
+#define FRAMEPOOL_H
+
+#include <QHash>
+#include <QMutex>
+#include <QVector>
+
+#include <ffmpeg.h>
+
+/**
+ * @brief Recycle AVFrame and the buffers of the converted frames,
+ *        the buffers are kept in an AVBufferPool per format and size
+ * @note All functions are thread-safe
+ */
+class FramePool
+{
+public:
+    FramePool() = default;
+    ~FramePool();
+
+    /**
+     * @return an empty frame, same as av_frame_alloc()
+     */
+    AVFrame *frame();
+
+    /**
+     * @return a frame with pooled buffers, nullptr if failed
+     */
+    AVFrame *videoFrame(AVPixelFormat format, int width, int height);
+    AVFrame *audioFrame(AVSampleFormat format, const AVChannelLayout &layout, int samples);
+
+    /**
+     * @brief Unreference the frame and keep it for the next FramePool::frame(),
+     *        the pooled buffers go back to their pools
+     */
+    void recycle(AVFrame *frame);
+
+    /**
+     * @brief Release the buffer pools, the buffers which are still in use
+     *        will be freed when they are unreferenced
+     */
+    void clear();
+
+private:
+    struct BufferPool
+    {
+        AVBufferPool *planes[AV_NUM_DATA_POINTERS] = { nullptr };
+        int linesizes[AV_NUM_DATA_POINTERS] = { 0 };
+        int planeCount = 0;
+    };
+
+    BufferPool *videoPool(AVPixelFormat format, int width, int height);
+    BufferPool *audioPool(AVSampleFormat format, int channels, int samples);
+
+    static void releasePool(BufferPool &pool);
+
+    QMutex m_mutex;
+
+    // key: media type | format | width or samples | height or channels
+    QHash<quint64, BufferPool> m_pools;
+
+    QVector<AVFrame *> m_frames;
+};
+
+#endif // FRAMEPOOL_H
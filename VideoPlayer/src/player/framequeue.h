@@ -0,0 +1,318 @@
+/**
+ * @brief Frame Queue
+ * @anchor Ho 229
+ * @date 2023/5/8
+ */
+
+#ifndef FRAMEQUEUE_H
+#define FRAMEQUEUE_H
+
+#include <QMutex>
+#include <QtMath>
+#include <QAtomicInt>
+#include <QWaitCondition>
+#include <QScopedArrayPointer>
+
+/**
+ * @brief Wait-free single-producer/single-consumer ring buffer for decoded frames
+ * @note FrameQueue::push() must only be called by the producer (decode worker),
+ *       FrameQueue::pop(), FrameQueue::front() and FrameQueue::clear()
+ *       must only be called by the consumer, the rest are thread-safe.
+ */
+template <typename T>
+class FrameQueue
+{
+public:
+    using Deleter = void (*)(T);
+
+    /**
+     * @param capacity will be rounded up to a power of two
+     * @param deleter release the dropped frames
+     */
+    explicit FrameQueue(int capacity, Deleter deleter);
+    ~FrameQueue();
+
+    /**
+     * @param duration of the frame in seconds
+     * @param bytes memory held by the frame
+     * @return false if the queue is full
+     */
+    bool push(const T &frame, qreal duration, qint64 bytes = 0);
+
+    /**
+     * @return false if there is no valid frame
+     */
+    bool pop(T &frame);
+
+    /**
+     * @return nullptr if there is no valid frame, the pointer is valid until
+     *         the next FrameQueue::pop()
+     */
+    const T *front();
+
+    void clear();
+
+    /**
+     * @brief Drop all queued frames lazily, the consumer releases them when it
+     *        reaches them. They no longer count toward FrameQueue::count(), duration()
+     *        and bytes(). It could be called by any thread, the frames being pushed
+     *        meanwhile may go either way.
+     */
+    void invalidate();
+
+    /**
+     * @return count of the valid frames
+     */
+    int count() const;
+    bool isEmpty() const { return !this->count(); }
+
+    /**
+     * @return true if the ring has no free slot, the invalidated frames not released
+     *         yet still occupy theirs
+     */
+    bool isFull() const { return int(m_tail.loadAcquire() - m_head.loadAcquire()) >= m_capacity; }
+
+    int capacity() const { return m_capacity; }
+
+    /**
+     * @brief Release the queued frames and reallocate the ring
+     * @note Only call it while neither the producer nor the consumer is active
+     */
+    void setCapacity(int capacity);
+
+    /**
+     * @return total duration of the valid frames in seconds
+     */
+    qreal duration() const;
+
+    /**
+     * @return total memory held by the valid frames, the invalidated ones are
+     *         held until the consumer reaches them
+     */
+    qint64 bytes() const;
+
+    /**
+     * @brief Block the producer while isFull() returns true, at most msecs
+     */
+    template <typename Predicate>
+    void waitWhile(Predicate isFull, unsigned long msecs);
+
+    /**
+     * @brief Wake up the producer if it is waiting
+     */
+    void wake();
+    void wakeAll();
+
+private:
+    struct Slot
+    {
+        T frame;
+        qint64 duration;    // in microseconds
+        qint64 bytes;
+    };
+
+    inline void release(quint32 head);
+
+    /**
+     * @return position of the first valid frame
+     */
+    inline quint32 validHead() const;
+
+    int m_capacity;
+    quint32 m_mask;
+    const Deleter m_deleter;
+
+    QScopedArrayPointer<Slot> m_slots;
+
+    QAtomicInteger<quint32> m_head;     // Written by consumer
+    QAtomicInteger<quint32> m_tail;     // Written by producer
+
+    // Running totals by the position, the ones of the queued frames are the differences
+    QAtomicInteger<qint64> m_pushedDuration;        // Written by producer
+    QAtomicInteger<qint64> m_pushedBytes;
+    QAtomicInteger<qint64> m_releasedDuration;      // Written by consumer
+    QAtomicInteger<qint64> m_releasedBytes;
+
+    // The frames before them are invalidated
+    QAtomicInteger<quint32> m_validHead;
+    QAtomicInteger<qint64> m_invalidDuration;
+    QAtomicInteger<qint64> m_invalidBytes;
+
+    QMutex m_waitMutex;
+    QWaitCondition m_waitCondition;
+    QAtomicInt m_isWaiting;
+};
+
+template <typename T>
+FrameQueue<T>::FrameQueue(int capacity, Deleter deleter) :
+    m_capacity(int(qNextPowerOfTwo(quint32(qMax(1, capacity) - 1)))),
+    m_mask(quint32(m_capacity - 1)),
+    m_deleter(deleter),
+    m_slots(new Slot[m_capacity])
+{
+
+}
+
+template <typename T>
+FrameQueue<T>::~FrameQueue()
+{
+    this->clear();
+}
+
+template <typename T>
+bool FrameQueue<T>::push(const T &frame, qreal duration, qint64 bytes)
+{
+    const quint32 tail = m_tail.loadRelaxed();
+    if(tail - m_head.loadAcquire() >= quint32(m_capacity))
+        return false;
+
+    Slot &slot = m_slots[tail & m_mask];
+    slot.frame = frame;
+    slot.duration = qint64(duration * 1000000);
+    slot.bytes = bytes;
+
+    m_pushedDuration.fetchAndAddRelaxed(slot.duration);
+    m_pushedBytes.fetchAndAddRelaxed(slot.bytes);
+    m_tail.storeRelease(tail + 1);
+
+    return true;
+}
+
+template <typename T>
+bool FrameQueue<T>::pop(T &frame)
+{
+    if(!this->front())
+        return false;
+
+    const quint32 head = m_head.loadRelaxed();
+    frame = m_slots[head & m_mask].frame;
+
+    m_releasedDuration.fetchAndAddRelaxed(m_slots[head & m_mask].duration);
+    m_releasedBytes.fetchAndAddRelaxed(m_slots[head & m_mask].bytes);
+    m_head.storeRelease(head + 1);
+
+    return true;
+}
+
+template <typename T>
+const T *FrameQueue<T>::front()
+{
+    const quint32 tail = m_tail.loadAcquire();
+    quint32 head = m_head.loadRelaxed();
+
+    // Skip the invalidated frames
+    for(; head != tail; ++head)
+    {
+        if(qint32(head - m_validHead.loadAcquire()) >= 0)
+            return &m_slots[head & m_mask].frame;
+
+        this->release(head);
+    }
+
+    return nullptr;
+}
+
+template <typename T>
+void FrameQueue<T>::invalidate()
+{
+    m_invalidDuration.storeRelease(m_pushedDuration.loadAcquire());
+    m_invalidBytes.storeRelease(m_pushedBytes.loadAcquire());
+    m_validHead.storeRelease(m_tail.loadAcquire());
+}
+
+template <typename T>
+int FrameQueue<T>::count() const
+{
+    const quint32 head = this->validHead();
+    return int(m_tail.loadAcquire() - head);
+}
+
+template <typename T>
+qreal FrameQueue<T>::duration() const
+{
+    // The later of the released and the invalidated positions
+    const qint64 head = qMax(m_releasedDuration.loadAcquire(), m_invalidDuration.loadAcquire());
+    return qreal(qMax<qint64>(0, m_pushedDuration.loadAcquire() - head)) / 1000000;
+}
+
+template <typename T>
+qint64 FrameQueue<T>::bytes() const
+{
+    const qint64 head = qMax(m_releasedBytes.loadAcquire(), m_invalidBytes.loadAcquire());
+    return qMax<qint64>(0, m_pushedBytes.loadAcquire() - head);
+}
+
+template <typename T>
+void FrameQueue<T>::clear()
+{
+    const quint32 tail = m_tail.loadAcquire();
+    for(quint32 head = m_head.loadRelaxed(); head != tail; ++head)
+        this->release(head);
+}
+
+template <typename T>
+void FrameQueue<T>::setCapacity(int capacity)
+{
+    this->clear();
+
+    capacity = int(qNextPowerOfTwo(quint32(qMax(1, capacity) - 1)));
+    if(capacity == m_capacity)
+        return;
+
+    m_capacity = capacity;
+    m_mask = quint32(m_capacity - 1);
+    m_slots.reset(new Slot[m_capacity]);
+}
+
+template <typename T>
+template <typename Predicate>
+void FrameQueue<T>::waitWhile(Predicate isFull, unsigned long msecs)
+{
+    QMutexLocker locker(&m_waitMutex);
+    m_isWaiting.storeRelease(1);
+
+    // The timeout covers a wake-up missed between the predicate and the wait
+    if(isFull())
+        m_waitCondition.wait(&m_waitMutex, msecs);
+
+    m_isWaiting.storeRelease(0);
+}
+
+template <typename T>
+void FrameQueue<T>::wake()
+{
+    if(!m_isWaiting.loadAcquire())
+        return;
+
+    QMutexLocker locker(&m_waitMutex);
+    m_waitCondition.wakeOne();
+}
+
+template <typename T>
+void FrameQueue<T>::wakeAll()
+{
+    QMutexLocker locker(&m_waitMutex);
+    m_waitCondition.wakeAll();
+}
+
+template <typename T>
+void FrameQueue<T>::release(quint32 head)
+{
+    Slot &slot = m_slots[head & m_mask];
+    m_deleter(slot.frame);
+
+    m_releasedDuration.fetchAndAddRelaxed(slot.duration);
+    m_releasedBytes.fetchAndAddRelaxed(slot.bytes);
+    m_head.storeRelease(head + 1);
+}
+
+template <typename T>
+quint32 FrameQueue<T>::validHead() const
+{
+    const quint32 head = m_head.loadAcquire();
+    const quint32 validHead = m_validHead.loadAcquire();
+
+    return qint32(validHead - head) > 0 ? validHead : head;
+}
+
+#endif // FRAMEQUEUE_H
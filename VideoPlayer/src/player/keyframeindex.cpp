@@ -0,0 +1,206 @@
+/**
+ * @brief Keyframe Index
+ * @anchor Ho 229
+ * @date 2023/5/16
+ */
+
+#include "keyframeindex.h"
+
+#include <ffmpeg.h>
+
+#include <QDir>
+#include <QDebug>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QDateTime>
+#include <QDataStream>
+#include <QMutexLocker>
+#include <QStandardPaths>
+#include <QCryptographicHash>
+
+#include <algorithm>
+
+#define CACHE_MAGIC 0x4B465849      // "KFXI"
+#define CACHE_VERSION 1
+
+KeyframeIndex::KeyframeIndex(QObject *parent) :
+    QThread(parent)
+{
+
+}
+
+KeyframeIndex::~KeyframeIndex()
+{
+    this->reset();
+}
+
+void KeyframeIndex::load(const QString &fileName, int streamIndex)
+{
+    this->reset();
+
+    m_fileName = fileName;
+    m_streamIndex = streamIndex;
+
+    if(this->readCache())
+        m_isReady = true;
+    else
+        this->start(QThread::LowPriority);
+}
+
+void KeyframeIndex::reset()
+{
+    if(this->isRunning())
+    {
+        this->requestInterruption();
+        this->wait();
+    }
+
+    m_isReady = false;
+    m_streamIndex = -1;
+
+    QMutexLocker locker(&m_mutex);
+    m_entries.clear();
+}
+
+bool KeyframeIndex::find(qreal time, Entry &entry) const
+{
+    if(!m_isReady)
+        return false;
+
+    QMutexLocker locker(&m_mutex);
+
+    auto it = std::upper_bound(m_entries.cbegin(), m_entries.cend(), time,
+                               [](qreal time, const Entry &entry) { return time < entry.time; });
+    if(it == m_entries.cbegin())
+        return false;
+
+    entry = *(it - 1);
+    return true;
+}
+
+void KeyframeIndex::run()
+{
+    AVFormatContext *formatContext = avformat_alloc_context();
+    if(!formatContext)
+        return;
+
+    // Abort the blocking reads on interruption
+    formatContext->interrupt_callback.callback = [](void *opaque) -> int {
+        return static_cast<KeyframeIndex *>(opaque)->isInterruptionRequested();
+    };
+    formatContext->interrupt_callback.opaque = this;
+
+    // formatContext is freed on failure
+    if(avformat_open_input(&formatContext, m_fileName.toUtf8().constData(), nullptr, nullptr) < 0)
+        return;
+
+    if(m_streamIndex < 0 || unsigned(m_streamIndex) >= formatContext->nb_streams)
+    {
+        avformat_close_input(&formatContext);
+        return;
+    }
+
+    // Only the positions of the key frames are needed
+    for(unsigned i = 0; i < formatContext->nb_streams; ++i)
+        formatContext->streams[i]->discard = int(i) == m_streamIndex ? AVDISCARD_DEFAULT : AVDISCARD_ALL;
+
+    const AVRational timeBase = formatContext->streams[m_streamIndex]->time_base;
+
+    QVector<Entry> entries;
+    AVPacket *packet = av_packet_alloc();
+
+    int ret = 0;
+    while(!this->isInterruptionRequested() && (ret = av_read_frame(formatContext, packet)) >= 0)
+    {
+        const qint64 timestamp = packet->pts != AV_NOPTS_VALUE ? packet->pts : packet->dts;
+
+        if(packet->stream_index == m_streamIndex && packet->flags & AV_PKT_FLAG_KEY &&
+            packet->pos >= 0 && timestamp != AV_NOPTS_VALUE)
+            entries.append({ qreal(timestamp) * av_q2d(timeBase), packet->pos });
+
+        av_packet_unref(packet);
+    }
+
+    av_packet_free(&packet);
+    avformat_close_input(&formatContext);
+
+    // Incomplete
+    if(ret != AVERROR_EOF)
+        return;
+
+    std::sort(entries.begin(), entries.end(),
+              [](const Entry &a, const Entry &b) { return a.time < b.time; });
+
+    {
+        QMutexLocker locker(&m_mutex);
+        m_entries.swap(entries);
+    }
+
+    m_isReady = true;
+    this->writeCache();
+}
+
+bool KeyframeIndex::readCache()
+{
+    QFile file(cacheFilePath(m_fileName, m_streamIndex));
+    if(!file.open(QIODevice::ReadOnly))
+        return false;
+
+    QDataStream stream(&file);
+
+    quint32 magic = 0, version = 0, count = 0;
+    stream >> magic >> version >> count;
+    if(magic != CACHE_MAGIC || version != CACHE_VERSION ||
+        qint64(count) * (sizeof(double) + sizeof(qint64)) > file.size())
+        return false;
+
+    QVector<Entry> entries(int(count));
+    for(Entry &entry : entries)
+        stream >> entry.time >> entry.offset;
+
+    if(stream.status() != QDataStream::Ok)
+        return false;
+
+    QMutexLocker locker(&m_mutex);
+    m_entries.swap(entries);
+
+    return true;
+}
+
+void KeyframeIndex::writeCache() const
+{
+    const QString filePath = cacheFilePath(m_fileName, m_streamIndex);
+    if(!QDir().mkpath(QFileInfo(filePath).absolutePath()))
+        return;
+
+    QSaveFile file(filePath);
+    if(!file.open(QIODevice::WriteOnly))
+        return;
+
+    QDataStream stream(&file);
+
+    QMutexLocker locker(&m_mutex);
+    stream << quint32(CACHE_MAGIC) << quint32(CACHE_VERSION) << quint32(m_entries.size());
+
+    for(const Entry &entry : m_entries)
+        stream << entry.time << entry.offset;
+
+    locker.unlock();
+
+    if(!file.commit())
+        qWarning() << __FUNCTION__ << ": Write" << filePath << "failed.";
+}
+
+QString KeyframeIndex::cacheFilePath(const QString &fileName, int streamIndex)
+{
+    const QFileInfo fileInfo(fileName);
+
+    // A modified file gets a new key
+    const QByteArray key = fileInfo.absoluteFilePath().toUtf8() + '|' +
+                           QByteArray::number(fileInfo.size()) + '|' +
+                           QByteArray::number(fileInfo.lastModified().toMSecsSinceEpoch()) + '|' +
+                           QByteArray::number(streamIndex);
+
+    return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/keyframes/" +
+           QCryptographicHash::hash(key, QCryptographicHash::Sha1).toHex() + ".idx";
+}
@@ -0,0 +1,73 @@
+/**
+ * @brief Keyframe Index
+ * @anchor Ho 229
+ * @date 2023/5/16
+ */
+
+#ifndef KEYFRAMEINDEX_H
+#define KEYFRAMEINDEX_H
+
+#include <QMutex>
+#include <QThread>
+#include <QVector>
+
+/**
+ * @brief Byte offsets of the key frames of a video stream in a local file,
+ *        built by a background pass and cached on disk by path, size and modification time
+ */
+class KeyframeIndex final : public QThread
+{
+    Q_OBJECT
+public:
+    struct Entry
+    {
+        qreal time;         // in seconds
+        qint64 offset;      // in bytes
+    };
+
+    explicit KeyframeIndex(QObject *parent = nullptr);
+    ~KeyframeIndex() Q_DECL_OVERRIDE;
+
+    /**
+     * @brief Load the index of the stream from the disk cache, or start building it
+     */
+    void load(const QString &fileName, int streamIndex);
+
+    /**
+     * @brief Stop building and drop the index
+     */
+    void reset();
+
+    /**
+     * @return true if the index of the whole file is available
+     */
+    bool isReady() const { return m_isReady; }
+
+    int streamIndex() const { return m_streamIndex; }
+
+    /**
+     * @brief Find the last key frame at or before the time
+     * @return false if not found or the index is not ready
+     */
+    bool find(qreal time, Entry &entry) const;
+
+private:
+    void run() Q_DECL_OVERRIDE;
+
+    bool readCache();
+    void writeCache() const;
+
+    static QString cacheFilePath(const QString &fileName, int streamIndex);
+
+    QString m_fileName;
+    int m_streamIndex = -1;
+
+    mutable QMutex m_mutex;
+    QVector<Entry> m_entries;       // Sorted by time
+
+    volatile bool m_isReady = false;
+};
+
+Q_DECLARE_TYPEINFO(KeyframeIndex::Entry, Q_PRIMITIVE_TYPE);
+
+#endif // KEYFRAMEINDEX_H
@@ -0,0 +1,137 @@
+/**
+ * @brief Mapped File IO
+ * @anchor Ho 229
+ * @date 2023/5/23
+ */
+
+#include "config.h"
+#include "mappedfileio.h"
+
+#include <ffmpeg.h>
+
+#include <limits>
+#include <cstring>
+
+#ifdef Q_OS_UNIX
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+bool MappedFileIO::open(const QString &fileName)
+{
+    this->close();
+
+    m_file.setFileName(fileName);
+    if(!m_file.open(QIODevice::ReadOnly))
+        return false;
+
+    // Not a regular file or too large for the address space
+    m_size = m_file.size();
+    if(m_size <= 0 || quint64(m_size) > std::numeric_limits<size_t>::max() ||
+        !(m_data = m_file.map(0, m_size)))
+    {
+        this->close();
+        return false;
+    }
+
+    uchar *buffer = static_cast<uchar *>(av_malloc(MAPPED_IO_BUFFER_SIZE));
+    if(!buffer || !(m_context = avio_alloc_context(buffer, MAPPED_IO_BUFFER_SIZE, 0, this,
+                                                   &MappedFileIO::read, nullptr, &MappedFileIO::seek)))
+    {
+        av_free(buffer);
+        this->close();
+        return false;
+    }
+
+#ifdef Q_OS_UNIX
+    // The demuxer reads forward apart from the seeks, the pages behind are dropped earlier
+    madvise(m_data, size_t(m_size), MADV_SEQUENTIAL);
+#endif
+
+    this->readAhead(0);
+
+    return true;
+}
+
+void MappedFileIO::close()
+{
+    if(m_context)
+    {
+        // The buffer may have been reallocated by the AVIOContext
+        av_freep(&m_context->buffer);
+        avio_context_free(&m_context);
+    }
+
+    if(m_data)
+    {
+        m_file.unmap(m_data);
+        m_data = nullptr;
+    }
+
+    m_file.close();
+
+    m_size = 0;
+    m_pos = 0;
+    m_readAheadBegin = 0;
+    m_readAheadEnd = 0;
+}
+
+int MappedFileIO::read(void *opaque, uint8_t *buf, int size)
+{
+    MappedFileIO *io = static_cast<MappedFileIO *>(opaque);
+
+    const qint64 length = qMin<qint64>(size, io->m_size - io->m_pos);
+    if(length <= 0)
+        return AVERROR_EOF;
+
+    // Seeked out of the hinted range or half of it has been read
+    if(io->m_pos < io->m_readAheadBegin ||
+        (io->m_readAheadEnd < io->m_size && io->m_pos + length > io->m_readAheadEnd - MAPPED_IO_READ_AHEAD / 2))
+        io->readAhead(io->m_pos);
+
+    memcpy(buf, io->m_data + io->m_pos, size_t(length));
+    io->m_pos += length;
+
+    return int(length);
+}
+
+int64_t MappedFileIO::seek(void *opaque, int64_t offset, int whence)
+{
+    MappedFileIO *io = static_cast<MappedFileIO *>(opaque);
+
+    switch(whence & ~AVSEEK_FORCE)
+    {
+    case AVSEEK_SIZE:
+        return io->m_size;
+    case SEEK_SET:
+        break;
+    case SEEK_CUR:
+        offset += io->m_pos;
+        break;
+    case SEEK_END:
+        offset += io->m_size;
+        break;
+    default:
+        return AVERROR(EINVAL);
+    }
+
+    // Past the end reads AVERROR_EOF
+    if(offset < 0)
+        return AVERROR(EINVAL);
+
+    return io->m_pos = offset;
+}
+
+void MappedFileIO::readAhead(qint64 pos)
+{
+    m_readAheadBegin = pos;
+    m_readAheadEnd = qMin<qint64>(pos + MAPPED_IO_READ_AHEAD, m_size);
+
+#ifdef Q_OS_UNIX
+    // madvise() takes a page aligned address
+    static const qint64 pageSize = sysconf(_SC_PAGESIZE);
+    const qint64 begin = pos / pageSize * pageSize;
+
+    madvise(m_data + begin, size_t(m_readAheadEnd - begin), MADV_WILLNEED);
+#endif
+}
@@ -0,0 +1,61 @@
+/**
+ * @brief Mapped File IO
+ * @anchor Ho 229
+ * @date 2023/5/23
+ */
+
+#ifndef MAPPEDFILEIO_H
+#define MAPPEDFILEIO_H
+
+#include <QFile>
+
+struct AVIOContext;
+
+/**
+ * @brief AVIOContext reading a local file through a memory mapping, the reads of the demuxer
+ *        are copies from the page cache instead of the read() calls of the file protocol.
+ *        The kernel is hinted to read ahead of the position on the POSIX systems.
+ * @note A read error of the mapped pages, eg. a network share gone away, raises SIGBUS
+ *       rather than failing the read, see also PlayerConfig::mapLocalFiles
+ */
+class MappedFileIO final
+{
+public:
+    MappedFileIO() = default;
+    ~MappedFileIO() { this->close(); }
+
+    /**
+     * @return false if the file could not be mapped, eg. empty or larger than the address space
+     */
+    bool open(const QString &fileName);
+    void close();
+
+    /**
+     * @return nullptr if not opened, it is owned by the MappedFileIO
+     */
+    AVIOContext *context() const { return m_context; }
+
+private:
+    Q_DISABLE_COPY(MappedFileIO)
+
+    static int read(void *opaque, uint8_t *buf, int size);
+    static int64_t seek(void *opaque, int64_t offset, int whence);
+
+    /**
+     * @brief Hint the kernel to read MAPPED_IO_READ_AHEAD from the position
+     */
+    void readAhead(qint64 pos);
+
+    QFile m_file;
+    uchar *m_data = nullptr;
+    qint64 m_size = 0;
+    qint64 m_pos = 0;
+
+    // Range hinted by the last MappedFileIO::readAhead()
+    qint64 m_readAheadBegin = 0;
+    qint64 m_readAheadEnd = 0;
+
+    AVIOContext *m_context = nullptr;
+};
+
+#endif // MAPPEDFILEIO_H
@@ -0,0 +1,376 @@
+/**
+ * @brief Network Input
+ * @anchor Ho 229
+ * @date 2023/5/24
+ */
+
+#include "config.h"
+#include "tracer.h"
+#include "networkinput.h"
+
+#include <ffmpeg.h>
+
+#include <QCryptographicHash>
+
+#include <cstring>
+#include <algorithm>
+
+NetworkInput::NetworkInput(QObject *parent) :
+    QThread(parent)
+{
+
+}
+
+NetworkInput::~NetworkInput()
+{
+    this->close();
+}
+
+int NetworkInput::open(const QString &url, qint64 capacity, qint64 cacheBudget)
+{
+    this->close();
+
+    // Abort the blocking reads of the reader thread on close, and the connecting on
+    // NetworkInput::interrupt() as well
+    const AVIOInterruptCB interruptCallback = {
+        [](void *opaque) -> int {
+            NetworkInput *input = static_cast<NetworkInput *>(opaque);
+            if(input->isInterruptionRequested())
+                return 1;
+
+            QMutexLocker locker(&input->m_mutex);
+            return !input->m_context && input->m_isInterrupted;
+        },
+        this
+    };
+
+    // Reconnect on the network errors rather than ending the stream
+    AVDictionary *options = nullptr;
+    av_dict_set(&options, "reconnect", "1", 0);
+    av_dict_set(&options, "reconnect_on_network_error", "1", 0);
+
+    int ret = avio_open2(&m_source, url.toUtf8().constData(), AVIO_FLAG_READ,
+                         &interruptCallback, &options);
+    av_dict_free(&options);
+
+    if(ret < 0)
+        return ret;
+
+    m_size = avio_size(m_source);
+    m_isSeekable = m_source->seekable & AVIO_SEEKABLE_NORMAL;
+
+    // The ranges of a live stream are not fetched again
+    if(m_isSeekable && m_size > 0 && cacheBudget > 0)
+    {
+        // Neither the ETag nor the Last-Modified is exposed by the protocols of FFmpeg,
+        // a resource changed in place is told by its leading bytes instead
+        QByteArray head(int(qMin<qint64>(m_size, RANGE_CACHE_VALIDATOR_SIZE)), Qt::Uninitialized);
+        ret = avio_read(m_source, reinterpret_cast<uint8_t *>(head.data()), head.size());
+
+        if(ret == head.size())
+        {
+            m_sourcePos = ret;
+
+            if(m_cache.open(url, m_size, cacheBudget, QCryptographicHash::hash(head, QCryptographicHash::Sha1)))
+                m_cache.write(0, reinterpret_cast<const uint8_t *>(head.constData()), ret);
+        }
+        else    // Read again by the reader thread
+            m_sourcePos = qMax(ret, 0);
+    }
+
+    m_capacity = qMax<qint64>(capacity, NETWORK_READ_SIZE * 4);
+    m_ring.reset(new uint8_t[size_t(m_capacity)]);
+
+    uint8_t *buffer = static_cast<uint8_t *>(av_malloc(NETWORK_IO_BUFFER_SIZE));
+    if(!buffer || !(m_context = avio_alloc_context(buffer, NETWORK_IO_BUFFER_SIZE, 0, this,
+                                                   &NetworkInput::read, nullptr, &NetworkInput::seek)))
+    {
+        av_free(buffer);
+        this->close();
+        return AVERROR(ENOMEM);
+    }
+
+    // The seeks within the window are served even if the source is not seekable
+    m_context->seekable = m_isSeekable ? AVIO_SEEKABLE_NORMAL : 0;
+
+    // The initial fill is not an underrun
+    m_isSeeking = true;
+
+    this->setObjectName("NetworkInput");
+    this->start();
+
+    return 0;
+}
+
+void NetworkInput::close()
+{
+    if(this->isRunning())
+    {
+        this->requestInterruption();
+
+        m_mutex.lock();
+        m_spaceReady.wakeAll();
+        m_mutex.unlock();
+
+        this->wait();
+    }
+
+    if(m_context)
+    {
+        // The buffer may have been reallocated by the AVIOContext
+        av_freep(&m_context->buffer);
+        avio_context_free(&m_context);
+    }
+
+    avio_closep(&m_source);
+    m_sourcePos = 0;
+    m_cache.close();
+    m_cachedBytes.storeRelaxed(0);
+
+    m_ring.reset();
+    m_capacity = 0;
+    m_size = -1;
+    m_isSeekable = false;
+
+    m_begin = 0;
+    m_end = 0;
+    m_readPos = 0;
+    m_seekSerial = 0;
+
+    m_readAhead = 0;
+    m_bitRate = 0;
+
+    m_error = 0;
+    m_underruns = 0;
+    m_isSeeking = false;
+    m_isInterrupted = false;
+}
+
+void NetworkInput::setReadAhead(qreal seconds, qint64 bitRate)
+{
+    QMutexLocker locker(&m_mutex);
+
+    m_bitRate = qMax<qint64>(0, bitRate);
+    m_readAhead = seconds > 0 && m_bitRate > 0 ? qint64(seconds * m_bitRate / 8) : 0;
+
+    m_spaceReady.wakeAll();
+}
+
+void NetworkInput::interrupt()
+{
+    QMutexLocker locker(&m_mutex);
+
+    m_isInterrupted = true;
+    m_dataReady.wakeAll();
+}
+
+void NetworkInput::resume()
+{
+    QMutexLocker locker(&m_mutex);
+
+    if(!m_isInterrupted)
+        return;
+
+    m_isInterrupted = false;
+}
+
+qint64 NetworkInput::bufferedBytes() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_end - m_readPos;
+}
+
+qreal NetworkInput::bufferedSeconds() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_bitRate > 0 ? qreal(m_end - m_readPos) * 8 / m_bitRate : -1;
+}
+
+int NetworkInput::underruns() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_underruns;
+}
+
+bool NetworkInput::isAtEnd() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_error;
+}
+
+void NetworkInput::run()
+{
+    QMutexLocker locker(&m_mutex);
+
+    while(!this->isInterruptionRequested())
+    {
+        // Until the next seek after the end or an error
+        const qint64 ahead = m_end - m_readPos;
+        const qint64 limit = m_readAhead > 0 ? qMin(m_readAhead, m_capacity * 3 / 4) : m_capacity * 3 / 4;
+        if(m_error || ahead >= limit)
+        {
+            m_spaceReady.wait(&m_mutex);
+            continue;
+        }
+
+        // Contiguous in the ring, the part to be overwritten leaves the window first
+        const qint64 offset = m_end % m_capacity;
+        const int size = int(std::min({ limit - ahead, m_capacity - offset, qint64(NETWORK_READ_SIZE) }));
+        m_begin = qMax(m_begin, m_end + size - m_capacity);
+
+        const qint64 pos = m_end;
+        const quint64 seekSerial = m_seekSerial;
+
+        locker.unlock();
+        const int ret = this->fetch(pos, m_ring.data() + offset, size);
+        locker.relock();
+
+        // Dropped if seeked out of the window meanwhile
+        if(m_seekSerial != seekSerial)
+            continue;
+
+        if(ret > 0)
+        {
+            m_end += ret;
+            m_isSeeking = false;
+        }
+        else
+            m_error = ret < 0 ? ret : AVERROR_EOF;
+
+        m_dataReady.wakeAll();
+    }
+}
+
+int NetworkInput::fetch(qint64 pos, uint8_t *buf, int size)
+{
+    if(m_size > 0 && pos >= m_size)
+        return AVERROR_EOF;
+
+    if(m_cache.isOpen())
+    {
+        const qint64 cachedLength = m_cache.cachedLength(pos);
+        if(cachedLength > 0)
+        {
+            TRACE_SCOPE("cacheRead");
+
+            const int ret = m_cache.read(pos, buf, int(qMin<qint64>(size, cachedLength)));
+            if(ret > 0)
+            {
+                m_cachedBytes.fetchAndAddRelaxed(ret);
+                return ret;
+            }
+        }
+        else    // Until the next cached range
+            size = int(qMin<qint64>(size, m_cache.gapLength(pos)));
+    }
+
+    // The source is repositioned only when a gap is reached
+    if(m_sourcePos != pos)
+    {
+        const int64_t ret = avio_seek(m_source, pos, SEEK_SET);
+        if(ret < 0)
+            return int(ret);
+
+        m_sourcePos = pos;
+    }
+
+    TRACE_SCOPE("networkRead");
+
+    const int ret = avio_read_partial(m_source, buf, size);
+    if(ret > 0)
+    {
+        m_sourcePos += ret;
+
+        if(m_cache.isOpen())
+            m_cache.write(pos, buf, ret);
+    }
+
+    return ret;
+}
+
+int NetworkInput::read(void *opaque, uint8_t *buf, int size)
+{
+    NetworkInput *input = static_cast<NetworkInput *>(opaque);
+    QMutexLocker locker(&input->m_mutex);
+
+    auto isWaiting = [input] {
+        return input->m_readPos >= input->m_end && !input->m_error && !input->m_isInterrupted;
+    };
+
+    if(isWaiting())
+    {
+        TRACE_SCOPE("networkWait");
+
+        if(!input->m_isSeeking)
+            ++input->m_underruns;
+
+        while(isWaiting())
+            input->m_dataReady.wait(&input->m_mutex);
+    }
+
+    if(input->m_readPos >= input->m_end)
+        return input->m_isInterrupted ? AVERROR_EXIT : input->m_error;
+
+    const qint64 offset = input->m_readPos % input->m_capacity;
+    const int length = int(std::min({ qint64(size), input->m_end - input->m_readPos, input->m_capacity - offset }));
+
+    // The reader only writes behind the read position by a quarter of the ring
+    locker.unlock();
+    memcpy(buf, input->m_ring.data() + offset, size_t(length));
+    locker.relock();
+
+    input->m_readPos += length;
+    input->m_spaceReady.wakeAll();
+
+    return length;
+}
+
+int64_t NetworkInput::seek(void *opaque, int64_t offset, int whence)
+{
+    NetworkInput *input = static_cast<NetworkInput *>(opaque);
+    QMutexLocker locker(&input->m_mutex);
+
+    switch(whence & ~AVSEEK_FORCE)
+    {
+    case AVSEEK_SIZE:
+        return input->m_size >= 0 ? input->m_size : AVERROR(ENOSYS);
+    case SEEK_SET:
+        break;
+    case SEEK_CUR:
+        offset += input->m_readPos;
+        break;
+    case SEEK_END:
+        if(input->m_size < 0)
+            return AVERROR(ENOSYS);
+
+        offset += input->m_size;
+        break;
+    default:
+        return AVERROR(EINVAL);
+    }
+
+    if(offset < 0)
+        return AVERROR(EINVAL);
+
+    // Within the buffered window
+    if(offset >= input->m_begin && offset <= input->m_end)
+    {
+        input->m_readPos = offset;
+        input->m_spaceReady.wakeAll();
+
+        return offset;
+    }
+
+    if(!input->m_isSeekable)
+        return AVERROR(ESPIPE);
+
+    // The reader continues from the position
+    input->m_begin = input->m_end = input->m_readPos = offset;
+    ++input->m_seekSerial;
+    input->m_error = 0;
+    input->m_isSeeking = true;
+
+    input->m_spaceReady.wakeAll();
+
+    return offset;
+}
@@ -0,0 +1,150 @@
+/**
+ * @brief Network Input
+ * @anchor Ho 229
+ * @date 2023/5/24
+ */
+
+#ifndef NETWORKINPUT_H
+#define NETWORKINPUT_H
+
+#include "rangecache.h"
+
+#include <QMutex>
+#include <QThread>
+#include <QAtomicInteger>
+#include <QWaitCondition>
+#include <QScopedArrayPointer>
+
+struct AVIOContext;
+
+/**
+ * @brief AVIOContext of a network URL read ahead by its own thread into a ring buffer,
+ *        so a stall of the network is absorbed by the buffered data instead of stalling
+ *        the demuxer. A quarter of the ring is kept behind the read position, the seeks
+ *        within the buffered window are served from the ring and the others reconnect
+ *        if the source is seekable. The fetched ranges of a seekable source are kept
+ *        in a RangeCache, only its gaps are fetched from the network.
+ * @note The demuxer side, ie. the AVIOContext and NetworkInput::interrupt(), is thread safe
+ *       with the reader thread
+ */
+class NetworkInput final : public QThread
+{
+    Q_OBJECT
+public:
+    explicit NetworkInput(QObject *parent = nullptr);
+    ~NetworkInput() Q_DECL_OVERRIDE;
+
+    /**
+     * @brief Connect to the URL and start reading ahead
+     * @param capacity of the ring buffer in bytes
+     * @param cacheBudget of the RangeCache on the disk in bytes, 0 disables it
+     * @return a negative AVERROR if failed
+     */
+    int open(const QString &url, qint64 capacity, qint64 cacheBudget = 0);
+    void close();
+
+    bool isOpen() const { return m_context; }
+
+    /**
+     * @return nullptr if not opened, it is owned by the NetworkInput
+     */
+    AVIOContext *context() const { return m_context; }
+
+    /**
+     * @return true if the source supports the seeks beyond the buffered window
+     */
+    bool isSeekable() const { return m_isSeekable; }
+
+    /**
+     * @brief Stop reading ahead once the buffered data lasts for the seconds
+     *        at the bit rate, the whole ring is filled if either is unknown (0)
+     */
+    void setReadAhead(qreal seconds, qint64 bitRate);
+
+    /**
+     * @brief Let a read waiting for the network return AVERROR_EXIT, or NetworkInput::open()
+     *        give up connecting, thread safe
+     */
+    void interrupt();
+
+    /**
+     * @brief Read again after NetworkInput::interrupt(), the interrupted read has left
+     *        the AVIOContext at the end until it is seeked
+     */
+    void resume();
+
+    /**
+     * @return data buffered ahead of the read position, in bytes
+     */
+    qint64 bufferedBytes() const;
+
+    /**
+     * @return duration of the data buffered ahead at the bit rate of
+     *         NetworkInput::setReadAhead(), -1 if unknown
+     */
+    qreal bufferedSeconds() const;
+
+    qint64 capacity() const { return m_capacity; }
+
+    /**
+     * @return count of the reads which had to wait for the network, not counting
+     *         the first one after the open or a seek out of the buffered window
+     */
+    int underruns() const;
+
+    /**
+     * @return true if the source has been read to the end or failed
+     */
+    bool isAtEnd() const;
+
+    /**
+     * @return data read from the RangeCache instead of the network, in bytes
+     */
+    qint64 cachedBytes() const { return m_cachedBytes.loadRelaxed(); }
+
+private:
+    void run() Q_DECL_OVERRIDE;
+
+    static int read(void *opaque, uint8_t *buf, int size);
+    static int64_t seek(void *opaque, int64_t offset, int whence);
+
+    /**
+     * @brief Read the source at the position from the cache if covered,
+     *        otherwise from the network, called by the reader thread
+     * @return bytes read or a negative AVERROR
+     */
+    int fetch(qint64 pos, uint8_t *buf, int size);
+
+    // Read by the reader thread only
+    AVIOContext *m_source = nullptr;        // Of the protocol
+    qint64 m_sourcePos = 0;
+    RangeCache m_cache;
+    QAtomicInteger<qint64> m_cachedBytes{0};
+
+    AVIOContext *m_context = nullptr;       // Read by the demuxer
+
+    QScopedArrayPointer<uint8_t> m_ring;
+    qint64 m_capacity = 0;
+    qint64 m_size = -1;                     // Of the source, negative if unknown
+    bool m_isSeekable = false;
+
+    mutable QMutex m_mutex;
+    QWaitCondition m_dataReady;             // Wakes the demuxer
+    QWaitCondition m_spaceReady;            // Wakes the reader
+
+    // Positions in the source, [m_begin, m_end) is in the ring
+    qint64 m_begin = 0;
+    qint64 m_end = 0;
+    qint64 m_readPos = 0;
+    quint64 m_seekSerial = 0;               // Of the seeks out of the window
+
+    qint64 m_readAhead = 0;                 // In bytes, 0 means to fill the ring
+    qint64 m_bitRate = 0;
+
+    int m_error = 0;                        // AVERROR_EOF at the end
+    int m_underruns = 0;
+    bool m_isSeeking = false;               // No data since the open or the seek out of the window
+    bool m_isInterrupted = false;
+};
+
+#endif // NETWORKINPUT_H
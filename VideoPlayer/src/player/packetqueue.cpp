@@ -0,0 +1,101 @@
+/**
+ * @brief Packet Queue
+ * @anchor Ho 229
+ * @date 2023/5/6
+ */
+
+#include "packetqueue.h"
+
+#include <ffmpeg.h>
+
+#include <QMutexLocker>
+
+PacketQueue::PacketQueue(int capacity) :
+    m_capacity(capacity)
+{
+
+}
+
+PacketQueue::~PacketQueue()
+{
+    this->clear();
+}
+
+void PacketQueue::put(AVPacket *packet)
+{
+    AVPacket *queued = av_packet_alloc();
+    av_packet_move_ref(queued, packet);
+
+    QMutexLocker locker(&m_mutex);
+    m_packets.enqueue(queued);
+    m_size += queued->size;
+
+    m_notEmpty.wakeOne();
+}
+
+void PacketQueue::putEnd()
+{
+    QMutexLocker locker(&m_mutex);
+    m_packets.enqueue(av_packet_alloc());
+
+    m_notEmpty.wakeOne();
+}
+
+AVPacket *PacketQueue::take()
+{
+    QMutexLocker locker(&m_mutex);
+
+    while(m_packets.isEmpty() && !m_aborted)
+        m_notEmpty.wait(&m_mutex);
+
+    if(m_aborted)
+        return nullptr;
+
+    AVPacket *packet = m_packets.dequeue();
+    m_size -= packet->size;
+
+    return packet;
+}
+
+void PacketQueue::clear()
+{
+    QMutexLocker locker(&m_mutex);
+
+    while(!m_packets.isEmpty())
+    {
+        AVPacket *packet = m_packets.dequeue();
+        av_packet_free(&packet);
+    }
+
+    m_size = 0;
+}
+
+void PacketQueue::abort()
+{
+    QMutexLocker locker(&m_mutex);
+    m_aborted = true;
+    m_notEmpty.wakeAll();
+}
+
+void PacketQueue::start()
+{
+    QMutexLocker locker(&m_mutex);
+    m_aborted = false;
+}
+
+int PacketQueue::count() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_packets.size();
+}
+
+qint64 PacketQueue::size() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_size;
+}
+
+bool PacketQueue::isEndPacket(const AVPacket *packet)
+{
+    return !packet->data && !packet->size;
+}
@@ -0,0 +1,78 @@
+/**
+ * @brief Packet Queue
+ * @anchor Ho 229
+ * @date 2023/5/6
+ */
+
+#ifndef PACKETQUEUE_H
+#define PACKETQUEUE_H
+
+#include <QQueue>
+#include <QMutex>
+#include <QWaitCondition>
+
+struct AVPacket;
+
+/**
+ * @brief Bounded queue of demuxed packets shared by the demuxer and a decode worker
+ */
+class PacketQueue
+{
+public:
+    explicit PacketQueue(int capacity);
+    ~PacketQueue();
+
+    /**
+     * @brief Move the reference of packet into the queue
+     */
+    void put(AVPacket *packet);
+
+    /**
+     * @brief Append an empty packet which tells the decode worker to drain the codec
+     */
+    void putEnd();
+
+    /**
+     * @brief Block until a packet is available
+     * @return nullptr if the queue has been aborted, the caller owns the returned packet
+     */
+    AVPacket *take();
+
+    void clear();
+
+    /**
+     * @brief Wake up and reject the consumer blocked in PacketQueue::take()
+     */
+    void abort();
+    void start();
+
+    int count() const;
+
+    /**
+     * @return total size of the queued packets in bytes
+     */
+    qint64 size() const;
+
+    bool isFull() const { return this->count() >= m_capacity; }
+
+    /**
+     * @note Only call it while the demuxer and the decode worker are stopped
+     */
+    void setCapacity(int capacity) { m_capacity = qMax(1, capacity); }
+    int capacity() const { return m_capacity; }
+
+    static bool isEndPacket(const AVPacket *packet);
+
+private:
+    int m_capacity;
+
+    mutable QMutex m_mutex;
+    QWaitCondition m_notEmpty;
+
+    QQueue<AVPacket *> m_packets;
+    qint64 m_size = 0;
+
+    bool m_aborted = false;
+};
+
+#endif // PACKETQUEUE_H
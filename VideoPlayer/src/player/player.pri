@@ -4,15 +4,42 @@ DEPENDPATH += $$PWD
 HEADERS += \
    $$PWD/audiooutput.h \
    $$PWD/config.h \
+   $$PWD/decodeworker.h \
    $$PWD/ffmpeg.h \
    $$PWD/ffmpegdecoder.h \
+   $$PWD/framepool.h \
+   $$PWD/framequeue.h \
+   $$PWD/keyframeindex.h \
+   $$PWD/mappedfileio.h \
+   $$PWD/networkinput.h \
+   $$PWD/packetqueue.h \
+   $$PWD/playerconfig.h \
+   $$PWD/rangecache.h \
+   $$PWD/thumbnailgenerator.h \
+   $$PWD/thumbnailprovider.h \
+   $$PWD/tracer.h \
+   $$PWD/videonode.h \
    $$PWD/videoplayer.h \
    $$PWD/videoplayer_p.h \
-   $$PWD/videorenderer.h
+   $$PWD/videorenderer.h \
+   $$PWD/videotexture.h
 
 SOURCES += \
    $$PWD/audiooutput.cpp \
+   $$PWD/decodeworker.cpp \
    $$PWD/ffmpegdecoder.cpp \
+   $$PWD/framepool.cpp \
+   $$PWD/keyframeindex.cpp \
+   $$PWD/mappedfileio.cpp \
+   $$PWD/networkinput.cpp \
+   $$PWD/packetqueue.cpp \
+   $$PWD/playerconfig.cpp \
+   $$PWD/rangecache.cpp \
+   $$PWD/thumbnailgenerator.cpp \
+   $$PWD/thumbnailprovider.cpp \
+   $$PWD/tracer.cpp \
+   $$PWD/videonode.cpp \
    $$PWD/videoplayer.cpp \
    $$PWD/videoplayer_p.cpp \
-   $$PWD/videorenderer.cpp
+   $$PWD/videorenderer.cpp \
+   $$PWD/videotexture.cpp
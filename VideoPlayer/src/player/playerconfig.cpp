@@ -0,0 +1,75 @@
+/**
+ * @brief Player Configuration
+ * @anchor Ho 229
+ * @date 2023/5/14
+ */
+
+#include "config.h"
+#include "playerconfig.h"
+
+#include <QDebug>
+#include <QFileInfo>
+#include <QSettings>
+#include <QMetaProperty>
+
+PlayerConfig::PlayerConfig(QObject *parent) :
+    QObject(parent),
+    m_videoCacheSize(VIDEO_CACHE_SIZE),
+    m_audioCacheSize(AUDIO_CACHE_SIZE),
+    m_subtitleCacheSize(SUBTITLE_CACHE_SIZE),
+    m_cacheBudget(DEFAULT_CACHE_BUDGET),
+    m_lookAhead(DEFAULT_LOOK_AHEAD),
+    m_packetQueueSize(PACKET_QUEUE_SIZE),
+    m_packetQueueBytes(MAX_PACKET_QUEUE_BYTES),
+    m_networkBufferSize(DEFAULT_NETWORK_BUFFER_SIZE),
+    m_networkReadAhead(DEFAULT_NETWORK_READ_AHEAD),
+    m_diskCacheSize(DEFAULT_DISK_CACHE_SIZE),
+    m_thumbnailDiskCacheSize(DEFAULT_THUMBNAIL_DISK_CACHE_SIZE),
+    m_probeDuration(DEFAULT_PROBE_DURATION),
+    m_statsInterval(DEFAULT_STATS_INTERVAL)
+{
+
+}
+
+bool PlayerConfig::loadFile(const QString &fileName)
+{
+    if(!QFileInfo(fileName).isReadable())
+        return false;
+
+    const QSettings settings(fileName, QSettings::IniFormat);
+    if(settings.status() != QSettings::NoError)
+    {
+        qCritical() << __FUNCTION__ << ": Read" << fileName << "failed.";
+        return false;
+    }
+
+    const QMetaObject *meta = this->metaObject();
+    for(int i = meta->propertyOffset(); i < meta->propertyCount(); ++i)
+    {
+        const QMetaProperty property = meta->property(i);
+        const QVariant value = settings.value(property.name());
+
+        // Enumerations are written by their key names
+        if(value.isValid() && !property.write(this, value))
+            qWarning() << __FUNCTION__ << ": Invalid value of" << property.name() << value;
+    }
+
+    return true;
+}
+
+void PlayerConfig::loadEnvironment()
+{
+    const QMetaObject *meta = this->metaObject();
+    for(int i = meta->propertyOffset(); i < meta->propertyCount(); ++i)
+    {
+        const QMetaProperty property = meta->property(i);
+        const QByteArray name = "VIDEOPLAYER_" + QByteArray(property.name()).toUpper();
+
+        if(!qEnvironmentVariableIsSet(name))
+            continue;
+
+        const QString value = qEnvironmentVariable(name);
+        if(!property.write(this, value))
+            qWarning() << __FUNCTION__ << ": Invalid value of" << name << value;
+    }
+}
@@ -0,0 +1,167 @@
+/**
+ * @brief Player Configuration
+ * @anchor Ho 229
+ * @date 2023/5/14
+ */
+
+#ifndef PLAYERCONFIG_H
+#define PLAYERCONFIG_H
+
+#include <QObject>
+
+/**
+ * @brief Tunable parameters of VideoPlayer, the defaults are in config.h
+ * @note The changes take effect on the next load
+ */
+class PlayerConfig : public QObject
+{
+    Q_OBJECT
+
+    // Maximum count of the frames in each cache
+    Q_PROPERTY(int videoCacheSize MEMBER m_videoCacheSize NOTIFY changed)
+    Q_PROPERTY(int audioCacheSize MEMBER m_audioCacheSize NOTIFY changed)
+    Q_PROPERTY(int subtitleCacheSize MEMBER m_subtitleCacheSize NOTIFY changed)
+
+    // Memory shared by the frame caches, in bytes
+    Q_PROPERTY(qint64 cacheBudget MEMBER m_cacheBudget NOTIFY changed)
+
+    // Duration kept decoded ahead of the playback, in seconds
+    Q_PROPERTY(qreal lookAhead MEMBER m_lookAhead NOTIFY changed)
+
+    // Capacity of each packet queue, and total size of the queued packets in bytes
+    Q_PROPERTY(int packetQueueSize MEMBER m_packetQueueSize NOTIFY changed)
+    Q_PROPERTY(qint64 packetQueueBytes MEMBER m_packetQueueBytes NOTIFY changed)
+
+    Q_PROPERTY(ThreadingMode threadingMode MEMBER m_threadingMode NOTIFY changed)
+
+    // Thread count of the video codec, 0 means to detect automatically
+    Q_PROPERTY(int decodeThreadCount MEMBER m_decodeThreadCount NOTIFY changed)
+
+    Q_PROPERTY(SeekMode seekMode MEMBER m_seekMode NOTIFY changed)
+
+    // Buffer size of the audio output in bytes, 0 means the default of the device
+    Q_PROPERTY(int audioBufferSize MEMBER m_audioBufferSize NOTIFY changed)
+
+    // Latency after the audio output not reported by it, eg. of an HDMI sink, in seconds
+    Q_PROPERTY(qreal audioLatency MEMBER m_audioLatency NOTIFY changed)
+
+    // Read the local files through a memory mapping instead of the file protocol,
+    // a read error of a network share crashes the process then
+    Q_PROPERTY(bool mapLocalFiles MEMBER m_mapLocalFiles NOTIFY changed)
+
+    // Ring buffer of the network streams read ahead by their own thread, in bytes, 0 disables it.
+    // The read ahead stops at networkReadAhead seconds of the bit rate, 0 fills the buffer.
+    Q_PROPERTY(qint64 networkBufferSize MEMBER m_networkBufferSize NOTIFY changed)
+    Q_PROPERTY(qreal networkReadAhead MEMBER m_networkReadAhead NOTIFY changed)
+
+    // Disk space of the byte ranges fetched from the seekable network streams
+    // shared by all of them, in bytes, 0 disables the cache
+    Q_PROPERTY(qint64 diskCacheSize MEMBER m_diskCacheSize NOTIFY changed)
+
+    // Disk space of the seek bar thumbnails shared by all files, in bytes, 0 disables
+    // the disk store. Read by ThumbnailProvider on its creation.
+    Q_PROPERTY(qint64 thumbnailDiskCacheSize MEMBER m_thumbnailDiskCacheSize NOTIFY changed)
+
+    // Packets probed for the stream info on load, in seconds of the media, 0 means the default
+    // of FFmpeg (5s). Only the formats without a header telling the codec parameters are probed.
+    Q_PROPERTY(qreal probeDuration MEMBER m_probeDuration NOTIFY changed)
+
+    // Interval VideoPlayer::stats is updated at while playing, in milliseconds, 0 disables it
+    Q_PROPERTY(int statsInterval MEMBER m_statsInterval NOTIFY changed)
+
+public:
+    // Same as FFmpegDecoder::ThreadingMode
+    enum ThreadingMode
+    {
+        NoThreading,
+        AutoThreading,
+        FrameThreading,
+        SliceThreading
+    };
+    Q_ENUM(ThreadingMode)
+
+    enum SeekMode
+    {
+        AccurateSeek,       // Drop the frames before the target
+        KeyFrameSeek        // Start from the key frame before the target
+    };
+    Q_ENUM(SeekMode)
+
+    explicit PlayerConfig(QObject *parent = nullptr);
+
+    /**
+     * @brief Read the properties from an INI file, the keys are the property names
+     * @return false if the file could not be read
+     */
+    bool loadFile(const QString &fileName);
+
+    /**
+     * @brief Read the properties from the environment variables named
+     *        VIDEOPLAYER_ + upper case property name, eg. VIDEOPLAYER_LOOKAHEAD
+     */
+    void loadEnvironment();
+
+    int videoCacheSize() const { return m_videoCacheSize; }
+    int audioCacheSize() const { return m_audioCacheSize; }
+    int subtitleCacheSize() const { return m_subtitleCacheSize; }
+
+    qint64 cacheBudget() const { return m_cacheBudget; }
+    qreal lookAhead() const { return m_lookAhead; }
+
+    int packetQueueSize() const { return m_packetQueueSize; }
+    qint64 packetQueueBytes() const { return m_packetQueueBytes; }
+
+    ThreadingMode threadingMode() const { return m_threadingMode; }
+    int decodeThreadCount() const { return m_decodeThreadCount; }
+
+    SeekMode seekMode() const { return m_seekMode; }
+
+    int audioBufferSize() const { return m_audioBufferSize; }
+    qreal audioLatency() const { return m_audioLatency; }
+
+    bool mapLocalFiles() const { return m_mapLocalFiles; }
+
+    qint64 networkBufferSize() const { return m_networkBufferSize; }
+    qreal networkReadAhead() const { return m_networkReadAhead; }
+    qint64 diskCacheSize() const { return m_diskCacheSize; }
+    qint64 thumbnailDiskCacheSize() const { return m_thumbnailDiskCacheSize; }
+
+    qreal probeDuration() const { return m_probeDuration; }
+
+    int statsInterval() const { return m_statsInterval; }
+
+signals:
+    void changed();
+
+private:
+    int m_videoCacheSize;
+    int m_audioCacheSize;
+    int m_subtitleCacheSize;
+
+    qint64 m_cacheBudget;
+    qreal m_lookAhead;
+
+    int m_packetQueueSize;
+    qint64 m_packetQueueBytes;
+
+    ThreadingMode m_threadingMode = AutoThreading;
+    int m_decodeThreadCount = 0;
+
+    SeekMode m_seekMode = AccurateSeek;
+
+    int m_audioBufferSize = 0;
+    qreal m_audioLatency = 0;
+
+    bool m_mapLocalFiles = true;
+
+    qint64 m_networkBufferSize;
+    qreal m_networkReadAhead;
+    qint64 m_diskCacheSize;
+    qint64 m_thumbnailDiskCacheSize;
+
+    qreal m_probeDuration;
+
+    int m_statsInterval;
+};
+
+#endif // PLAYERCONFIG_H
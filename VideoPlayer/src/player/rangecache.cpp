@@ -0,0 +1,282 @@
+/**
+ * @brief Range Cache
+ * @anchor Ho 229
+ * @date 2023/5/25
+ */
+
+#include "config.h"
+#include "rangecache.h"
+
+#include <QDir>
+#include <QDebug>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QDateTime>
+#include <QDataStream>
+#include <QStandardPaths>
+#include <QCryptographicHash>
+
+#include <iterator>
+#include <algorithm>
+
+#define CACHE_MAGIC 0x52474343      // "RGCC"
+#define CACHE_VERSION 2
+
+bool RangeCache::open(const QString &url, qint64 size, qint64 budget, const QByteArray &validator)
+{
+    this->close();
+
+    const QString dir = cacheDir();
+    if(size <= 0 || budget <= 0 || !QDir().mkpath(dir))
+        return false;
+
+    m_key = QCryptographicHash::hash(url.toUtf8() + '|' + QByteArray::number(size),
+                                     QCryptographicHash::Sha1).toHex();
+    m_size = size;
+    m_budget = budget;
+    m_validator = validator;
+
+    // The data without a valid index is stale, or of another content
+    QIODevice::OpenMode mode = QIODevice::ReadWrite;
+    if(!this->readIndex())
+        mode |= QIODevice::Truncate;
+
+    m_data.setFileName(dir + m_key + ".data");
+    if(!m_data.open(mode))
+    {
+        qWarning() << __FUNCTION__ << ": Open" << m_data.fileName() << "failed.";
+
+        m_intervals.clear();
+        m_bytes = 0;
+
+        return false;
+    }
+
+    // The other entries by the last use, only the headers of their indexes are read
+    for(const QFileInfo &fileInfo : QDir(dir).entryInfoList({"*.idx"}, QDir::Files))
+    {
+        Entry entry = { fileInfo.completeBaseName(), 0, 0 };
+        if(entry.key == m_key)
+            continue;
+
+        QFile file(fileInfo.filePath());
+        if(!file.open(QIODevice::ReadOnly))
+            continue;
+
+        QDataStream stream(&file);
+
+        quint32 magic = 0, version = 0;
+        stream >> magic >> version >> entry.lastUsed >> entry.bytes;
+
+        if(magic == CACHE_MAGIC && version == CACHE_VERSION && stream.status() == QDataStream::Ok)
+        {
+            m_others.append(entry);
+            m_otherBytes += entry.bytes;
+        }
+        else
+        {
+            file.close();
+            QFile::remove(dir + entry.key + ".idx");
+            QFile::remove(dir + entry.key + ".data");
+        }
+    }
+
+    // Every entry writes its index on open, the data files without one are left by a crash
+    for(const QFileInfo &fileInfo : QDir(dir).entryInfoList({"*.data"}, QDir::Files))
+    {
+        if(!QFileInfo::exists(dir + fileInfo.completeBaseName() + ".idx"))
+            QFile::remove(fileInfo.filePath());
+    }
+
+    std::sort(m_others.begin(), m_others.end(),
+              [](const Entry &a, const Entry &b) { return a.lastUsed < b.lastUsed; });
+
+    this->evict(0);
+
+    // Marked as used now
+    this->writeIndex();
+
+    return true;
+}
+
+void RangeCache::close()
+{
+    if(m_data.isOpen())
+    {
+        this->writeIndex();
+        m_data.close();
+    }
+
+    m_key.clear();
+    m_size = 0;
+    m_budget = 0;
+    m_validator.clear();
+
+    m_intervals.clear();
+    m_bytes = 0;
+    m_unindexedBytes = 0;
+
+    m_others.clear();
+    m_otherBytes = 0;
+}
+
+qint64 RangeCache::cachedLength(qint64 pos) const
+{
+    auto it = m_intervals.upperBound(pos);
+    if(it == m_intervals.cbegin())
+        return 0;
+
+    --it;
+    return qMax<qint64>(0, it.value() - pos);
+}
+
+qint64 RangeCache::gapLength(qint64 pos) const
+{
+    const auto it = m_intervals.upperBound(pos);
+    return qMax<qint64>(0, (it == m_intervals.cend() ? m_size : it.key()) - pos);
+}
+
+int RangeCache::read(qint64 pos, uint8_t *buf, int size)
+{
+    if(!m_data.seek(pos))
+        return -1;
+
+    const qint64 ret = m_data.read(reinterpret_cast<char *>(buf), size);
+    return ret > 0 ? int(ret) : -1;
+}
+
+void RangeCache::write(qint64 pos, const uint8_t *buf, int size)
+{
+    // Only the bytes not cached yet take more of the budget
+    if(size <= 0 || pos < 0 || pos + size > m_size || !this->evict(size - this->coveredLength(pos, pos + size)))
+        return;
+
+    // Written past the end the file is sparse, except on the file systems without the support
+    if(!m_data.seek(pos) || m_data.write(reinterpret_cast<const char *>(buf), size) != size)
+        return;
+
+    qint64 begin = pos, end = pos + size;
+
+    // Merged with the overlapping and the adjacent intervals
+    auto it = m_intervals.upperBound(begin);
+    if(it != m_intervals.begin())
+    {
+        const auto previous = std::prev(it);
+        if(previous.value() >= begin)
+            it = previous;
+    }
+
+    while(it != m_intervals.end() && it.key() <= end)
+    {
+        begin = qMin(begin, it.key());
+        end = qMax(end, it.value());
+
+        m_bytes -= it.value() - it.key();
+        it = m_intervals.erase(it);
+    }
+
+    m_intervals.insert(begin, end);
+    m_bytes += end - begin;
+
+    if((m_unindexedBytes += size) >= RANGE_CACHE_INDEX_INTERVAL)
+        this->writeIndex();
+}
+
+bool RangeCache::readIndex()
+{
+    QFile file(cacheDir() + m_key + ".idx");
+    if(!file.open(QIODevice::ReadOnly))
+        return false;
+
+    QDataStream stream(&file);
+
+    quint32 magic = 0, version = 0, count = 0;
+    qint64 lastUsed = 0, bytes = 0;
+    QByteArray validator;
+    stream >> magic >> version >> lastUsed >> bytes >> validator >> count;
+
+    if(magic != CACHE_MAGIC || version != CACHE_VERSION || validator != m_validator ||
+        qint64(count) * 2 * sizeof(qint64) > file.size())
+        return false;
+
+    QMap<qint64, qint64> intervals;
+    bytes = 0;
+
+    for(quint32 i = 0; i < count; ++i)
+    {
+        qint64 begin = 0, end = 0;
+        stream >> begin >> end;
+
+        if(begin < 0 || end <= begin || end > m_size)
+            return false;
+
+        intervals.insert(begin, end);
+        bytes += end - begin;
+    }
+
+    if(stream.status() != QDataStream::Ok)
+        return false;
+
+    m_intervals.swap(intervals);
+    m_bytes = bytes;
+
+    return true;
+}
+
+void RangeCache::writeIndex()
+{
+    // The index never covers the data not written yet
+    if(!m_data.flush())
+        return;
+
+    QSaveFile file(cacheDir() + m_key + ".idx");
+    if(!file.open(QIODevice::WriteOnly))
+        return;
+
+    QDataStream stream(&file);
+    stream << quint32(CACHE_MAGIC) << quint32(CACHE_VERSION)
+           << QDateTime::currentMSecsSinceEpoch() << m_bytes << m_validator << quint32(m_intervals.size());
+
+    for(auto it = m_intervals.cbegin(); it != m_intervals.cend(); ++it)
+        stream << it.key() << it.value();
+
+    if(!file.commit())
+        qWarning() << __FUNCTION__ << ": Write" << file.fileName() << "failed.";
+
+    m_unindexedBytes = 0;
+}
+
+bool RangeCache::evict(qint64 bytes)
+{
+    const QString dir = cacheDir();
+
+    while(!m_others.isEmpty() && m_otherBytes + m_bytes + bytes > m_budget)
+    {
+        const Entry entry = m_others.takeFirst();
+
+        QFile::remove(dir + entry.key + ".idx");
+        QFile::remove(dir + entry.key + ".data");
+
+        m_otherBytes -= entry.bytes;
+    }
+
+    return m_otherBytes + m_bytes + bytes <= m_budget;
+}
+
+qint64 RangeCache::coveredLength(qint64 begin, qint64 end) const
+{
+    auto it = m_intervals.upperBound(begin);
+    if(it != m_intervals.cbegin())
+        --it;
+
+    qint64 length = 0;
+    for(; it != m_intervals.cend() && it.key() < end; ++it)
+        length += qMax<qint64>(0, qMin(end, it.value()) - qMax(begin, it.key()));
+
+    return length;
+}
+
+QString RangeCache::cacheDir()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/ranges/";
+}
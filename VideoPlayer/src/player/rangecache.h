@@ -0,0 +1,103 @@
+/**
+ * @brief Range Cache
+ * @anchor Ho 229
+ * @date 2023/5/25
+ */
+
+#ifndef RANGECACHE_H
+#define RANGECACHE_H
+
+#include <QMap>
+#include <QFile>
+#include <QVector>
+#include <QByteArray>
+
+/**
+ * @brief Persistent cache of the byte ranges fetched from a remote resource, stored in
+ *        a sparse data file with an index of the covered intervals. The entries are keyed
+ *        by the URL and the size and validated by the validator of the resource, the least
+ *        recently used ones are evicted to keep all of them within the budget.
+ * @note Not thread safe, used by the reader thread of NetworkInput only
+ */
+class RangeCache final
+{
+public:
+    RangeCache() = default;
+    ~RangeCache() { this->close(); }
+
+    /**
+     * @param size of the resource in bytes, a resource of another size is another entry
+     * @param budget of all entries on the disk, in bytes
+     * @param validator of the content, the entry stored with another one is truncated
+     * @return false if the cache directory is not writable
+     */
+    bool open(const QString &url, qint64 size, qint64 budget, const QByteArray &validator);
+
+    /**
+     * @brief Write the index
+     */
+    void close();
+
+    bool isOpen() const { return m_data.isOpen(); }
+
+    /**
+     * @return length cached from the position, 0 if it is in a gap
+     */
+    qint64 cachedLength(qint64 pos) const;
+
+    /**
+     * @return length of the gap from the position until the next cached interval or the end
+     */
+    qint64 gapLength(qint64 pos) const;
+
+    /**
+     * @return bytes read, negative if failed
+     */
+    int read(qint64 pos, uint8_t *buf, int size);
+
+    /**
+     * @brief Store the fetched bytes, nothing is stored once the entry alone exceeds the budget
+     */
+    void write(qint64 pos, const uint8_t *buf, int size);
+
+private:
+    Q_DISABLE_COPY(RangeCache)
+
+    struct Entry
+    {
+        QString key;
+        qint64 lastUsed;        // in milliseconds since epoch
+        qint64 bytes;
+    };
+
+    bool readIndex();
+    void writeIndex();
+
+    /**
+     * @brief Remove the least recently used other entries until the bytes fit in the budget
+     * @return false if they do not fit even without the others
+     */
+    bool evict(qint64 bytes);
+
+    /**
+     * @return length of [begin, end) covered by the intervals
+     */
+    qint64 coveredLength(qint64 begin, qint64 end) const;
+
+    static QString cacheDir();
+
+    QString m_key;
+    qint64 m_size = 0;
+    qint64 m_budget = 0;
+    QByteArray m_validator;
+
+    QFile m_data;
+    QMap<qint64, qint64> m_intervals;   // Disjoint [begin, end) by begin
+    qint64 m_bytes = 0;                 // Covered by the intervals
+    qint64 m_unindexedBytes = 0;        // Written since the index was written
+
+    QVector<Entry> m_others;            // Ordered by lastUsed
+    qint64 m_otherBytes = 0;
+};
+
+#endif // RANGECACHE_H
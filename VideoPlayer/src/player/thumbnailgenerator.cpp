@@ -0,0 +1,421 @@
+/**
+ * @brief Thumbnail Generator
+ * @anchor Ho 229
+ * @date 2023/5/17
+ */
+
+#include "config.h"
+#include "thumbnailgenerator.h"
+
+#include <ffmpeg.h>
+
+#include <QDir>
+#include <QFile>
+#include <QDebug>
+#include <QBuffer>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QDeadlineTimer>
+#include <QStandardPaths>
+#include <QCryptographicHash>
+
+#include <cmath>
+#include <algorithm>
+
+#define USED_FILE_NAME "used"     // Marks the last use of a directory by its modification time
+
+ThumbnailGenerator::ThumbnailGenerator(QObject *parent) :
+    QThread(parent)
+{
+    m_cache.setMaxCost(THUMBNAIL_CACHE_SIZE);
+    m_diskCacheSize = DEFAULT_THUMBNAIL_DISK_CACHE_SIZE;
+}
+
+ThumbnailGenerator::~ThumbnailGenerator()
+{
+    this->reset();
+}
+
+void ThumbnailGenerator::load(const QString &fileName)
+{
+    this->reset();
+
+    const QFileInfo fileInfo(fileName);
+
+    // A modified file gets a new directory
+    const QByteArray key = fileInfo.absoluteFilePath().toUtf8() + '|' +
+                           QByteArray::number(fileInfo.size()) + '|' +
+                           QByteArray::number(fileInfo.lastModified().toMSecsSinceEpoch());
+
+    QMutexLocker locker(&m_mutex);
+
+    m_fileName = fileName;
+    m_diskBudget = m_diskCacheSize;
+    m_cacheDir = QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/thumbnails/" +
+                 QCryptographicHash::hash(key, QCryptographicHash::Sha1).toHex();
+
+    locker.unlock();
+
+    this->start(QThread::LowestPriority);
+}
+
+void ThumbnailGenerator::reset()
+{
+    if(this->isRunning())
+    {
+        this->requestInterruption();
+
+        m_mutex.lock();
+        m_requestCondition.wakeAll();
+        m_mutex.unlock();
+
+        this->wait();
+    }
+
+    QMutexLocker locker(&m_mutex);
+
+    m_fileName.clear();
+    m_cacheDir.clear();
+
+    m_cache.clear();
+    m_finishedSlots.clear();
+
+    m_requestedSlot = -1;
+    ++m_serial;
+
+    // Release the waiting requests of the previous file
+    m_generateCondition.wakeAll();
+}
+
+QString ThumbnailGenerator::fileName() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_fileName;
+}
+
+void ThumbnailGenerator::setDiskCacheSize(qint64 size)
+{
+    QMutexLocker locker(&m_mutex);
+    m_diskCacheSize = qMax<qint64>(0, size);
+}
+
+QImage ThumbnailGenerator::thumbnail(qreal time, int timeout)
+{
+    if(time < 0)
+        return {};
+
+    const int slot = int(time / THUMBNAIL_INTERVAL);
+    const QDeadlineTimer deadline(timeout);
+
+    QMutexLocker locker(&m_mutex);
+    const int serial = m_serial;
+
+    forever
+    {
+        if(const QImage *image = m_cache.object(slot))
+            return *image;
+
+        if(m_finishedSlots.contains(slot))
+        {
+            // Evicted from the memory
+            QImage image(this->cacheFilePath(slot));
+            if(!image.isNull())
+                m_cache.insert(slot, new QImage(image), int(image.sizeInBytes()));
+
+            return image;
+        }
+
+        if(!this->isRunning())
+            return {};
+
+        m_requestedSlot = slot;
+        m_requestCondition.wakeAll();
+
+        if(!m_generateCondition.wait(&m_mutex, deadline) || serial != m_serial)
+            return {};
+    }
+}
+
+void ThumbnailGenerator::run()
+{
+    if(!this->openInput())
+    {
+        this->closeInput();
+        return;
+    }
+
+    // Without the disk store the thumbnails evicted from the memory are not available
+    const bool isStored = m_diskBudget > 0 && QDir().mkpath(m_cacheDir);
+    if(isStored)
+        this->openDiskCache();
+
+    const int slotCount = m_formatContext->duration > 0 ?
+                              int(std::ceil(qreal(m_formatContext->duration) / AV_TIME_BASE / THUMBNAIL_INTERVAL)) : 0;
+    int nextSlot = 0;
+
+    forever
+    {
+        int slot = -1;
+
+        m_mutex.lock();
+
+        while(!this->isInterruptionRequested())
+        {
+            // The hovered position goes first
+            if(m_requestedSlot >= 0 && !m_finishedSlots.contains(m_requestedSlot))
+            {
+                slot = m_requestedSlot;
+                m_requestedSlot = -1;
+                break;
+            }
+
+            while(nextSlot < slotCount && m_finishedSlots.contains(nextSlot))
+                ++nextSlot;
+
+            if(nextSlot < slotCount)
+            {
+                slot = nextSlot++;
+                break;
+            }
+
+            m_requestCondition.wait(&m_mutex);
+        }
+
+        m_mutex.unlock();
+
+        if(slot < 0)
+            break;
+
+        // The ones generated by the previous runs are read from the disk on request
+        const QString filePath = this->cacheFilePath(slot);
+
+        QImage image;
+        if(!(isStored && QFile::exists(filePath)) && !(image = this->decode(slot)).isNull() && isStored)
+            this->saveImage(filePath, image);
+
+        if(this->isInterruptionRequested())
+            break;
+
+        m_mutex.lock();
+
+        if(!image.isNull())
+            m_cache.insert(slot, new QImage(image), int(image.sizeInBytes()));
+
+        m_finishedSlots.insert(slot);
+        m_generateCondition.wakeAll();
+
+        m_mutex.unlock();
+    }
+
+    this->closeInput();
+}
+
+bool ThumbnailGenerator::openInput()
+{
+    m_formatContext = avformat_alloc_context();
+    if(!m_formatContext)
+        return false;
+
+    // Abort the blocking reads on interruption
+    m_formatContext->interrupt_callback.callback = [](void *opaque) -> int {
+        return static_cast<ThumbnailGenerator *>(opaque)->isInterruptionRequested();
+    };
+    m_formatContext->interrupt_callback.opaque = this;
+
+    // m_formatContext is freed on failure
+    if(avformat_open_input(&m_formatContext, m_fileName.toUtf8().constData(), nullptr, nullptr) < 0 ||
+        avformat_find_stream_info(m_formatContext, nullptr) < 0)
+        return false;
+
+    const AVCodec *codec = nullptr;
+    const int index = av_find_best_stream(m_formatContext, AVMEDIA_TYPE_VIDEO, -1, -1, &codec, 0);
+    if(index < 0)
+        return false;
+
+    m_stream = m_formatContext->streams[index];
+
+    // Cover arts have no timeline
+    if(m_stream->disposition & AV_DISPOSITION_ATTACHED_PIC)
+        return false;
+
+    for(unsigned i = 0; i < m_formatContext->nb_streams; ++i)
+        m_formatContext->streams[i]->discard = int(i) == index ? AVDISCARD_DEFAULT : AVDISCARD_ALL;
+
+    if(!(m_codecContext = avcodec_alloc_context3(codec)) ||
+        avcodec_parameters_to_context(m_codecContext, m_stream->codecpar) < 0)
+        return false;
+
+    // The cheap path: key frames only on one thread, without the loop filter
+    // and at the lowest resolution the codec supports above THUMBNAIL_WIDTH
+    m_codecContext->thread_count = 1;
+    m_codecContext->skip_frame = AVDISCARD_NONKEY;
+    m_codecContext->skip_loop_filter = AVDISCARD_ALL;
+    m_codecContext->flags2 |= AV_CODEC_FLAG2_FAST;
+
+    int lowres = 0;
+    while(lowres < codec->max_lowres && (m_codecContext->width >> (lowres + 1)) >= THUMBNAIL_WIDTH)
+        ++lowres;
+    m_codecContext->lowres = lowres;
+
+    if(avcodec_open2(m_codecContext, codec, nullptr) < 0)
+    {
+        qWarning() << __FUNCTION__ << ": Open decoder of" << m_fileName << "failed.";
+        return false;
+    }
+
+    return true;
+}
+
+void ThumbnailGenerator::closeInput()
+{
+    avcodec_free_context(&m_codecContext);
+    avformat_close_input(&m_formatContext);
+
+    sws_freeContext(m_swsContext);
+    m_swsContext = nullptr;
+
+    m_stream = nullptr;
+}
+
+QImage ThumbnailGenerator::decode(int slot)
+{
+    qint64 timestamp = av_rescale_q(qint64(slot) * THUMBNAIL_INTERVAL * AV_TIME_BASE,
+                                    AV_TIME_BASE_Q, m_stream->time_base);
+    if(m_stream->start_time != AV_NOPTS_VALUE)
+        timestamp += m_stream->start_time;
+
+    if(av_seek_frame(m_formatContext, m_stream->index, timestamp, AVSEEK_FLAG_BACKWARD) < 0)
+        return {};
+
+    avcodec_flush_buffers(m_codecContext);
+
+    AVPacket *packet = av_packet_alloc();
+    AVFrame *frame = av_frame_alloc();
+
+    QImage image;
+    for(int i = 0; i < THUMBNAIL_MAX_PACKETS && !this->isInterruptionRequested(); ++i)
+    {
+        const bool isEnd = av_read_frame(m_formatContext, packet) < 0;
+
+        if(!isEnd && packet->stream_index != m_stream->index)
+        {
+            av_packet_unref(packet);
+            continue;
+        }
+
+        // Flush the decoder at the end
+        avcodec_send_packet(m_codecContext, isEnd ? nullptr : packet);
+        av_packet_unref(packet);
+
+        if(avcodec_receive_frame(m_codecContext, frame) >= 0)
+        {
+            image = this->toImage(frame);
+            av_frame_unref(frame);
+            break;
+        }
+
+        if(isEnd)
+            break;
+    }
+
+    av_frame_free(&frame);
+    av_packet_free(&packet);
+
+    return image;
+}
+
+QImage ThumbnailGenerator::toImage(const AVFrame *frame)
+{
+    const qreal aspectRatio = frame->sample_aspect_ratio.num > 0 ?
+                                  av_q2d(frame->sample_aspect_ratio) : 1.;
+    const int height = qMax(1, qRound(THUMBNAIL_WIDTH * frame->height / (frame->width * aspectRatio)));
+
+    m_swsContext = sws_getCachedContext(m_swsContext, frame->width, frame->height,
+                                        static_cast<AVPixelFormat>(frame->format),
+                                        THUMBNAIL_WIDTH, height, AV_PIX_FMT_RGB32,
+                                        SWS_FAST_BILINEAR, nullptr, nullptr, nullptr);
+    if(!m_swsContext)
+        return {};
+
+    QImage image(THUMBNAIL_WIDTH, height, QImage::Format_RGB32);
+
+    uint8_t *data[4] = { image.bits() };
+    int linesize[4] = { int(image.bytesPerLine()) };
+
+    sws_scale(m_swsContext, frame->data, frame->linesize, 0, frame->height, data, linesize);
+
+    return image;
+}
+
+QString ThumbnailGenerator::cacheFilePath(int slot) const
+{
+    return m_cacheDir + '/' + QString::number(slot) + ".jpg";
+}
+
+void ThumbnailGenerator::openDiskCache()
+{
+    m_diskBytes = 0;
+    m_others.clear();
+    m_otherBytes = 0;
+
+    // The directories of the other files by the last use
+    const QFileInfo thisDir(m_cacheDir);
+    for(const QFileInfo &dirInfo : thisDir.dir().entryInfoList(QDir::Dirs | QDir::NoDotAndDotDot))
+    {
+        const QFileInfo usedInfo(dirInfo.filePath() + "/" USED_FILE_NAME);
+        Entry entry = { dirInfo.absoluteFilePath(),
+                        usedInfo.exists() ? usedInfo.lastModified().toMSecsSinceEpoch() : 0, 0 };
+
+        for(const QFileInfo &fileInfo : QDir(entry.path).entryInfoList(QDir::Files))
+            entry.bytes += fileInfo.size();
+
+        if(entry.path == thisDir.absoluteFilePath())
+            m_diskBytes = entry.bytes;
+        else
+        {
+            m_others.append(entry);
+            m_otherBytes += entry.bytes;
+        }
+    }
+
+    std::sort(m_others.begin(), m_others.end(),
+              [](const Entry &a, const Entry &b) { return a.lastUsed < b.lastUsed; });
+
+    this->evict(0);
+
+    // Marked as used now
+    QFile usedFile(m_cacheDir + "/" USED_FILE_NAME);
+    if(usedFile.open(QIODevice::WriteOnly))
+        usedFile.setFileTime(QDateTime::currentDateTime(), QFileDevice::FileModificationTime);
+}
+
+void ThumbnailGenerator::saveImage(const QString &filePath, const QImage &image)
+{
+    QByteArray data;
+    QBuffer buffer(&data);
+    if(!buffer.open(QIODevice::WriteOnly) || !image.save(&buffer, "JPG", 80) || !this->evict(data.size()))
+        return;
+
+    QFile file(filePath);
+    if(!file.open(QIODevice::WriteOnly) || file.write(data) != data.size())
+    {
+        qWarning() << __FUNCTION__ << ": Write" << filePath << "failed.";
+        file.remove();
+        return;
+    }
+
+    m_diskBytes += data.size();
+}
+
+bool ThumbnailGenerator::evict(qint64 bytes)
+{
+    while(!m_others.isEmpty() && m_otherBytes + m_diskBytes + bytes > m_diskBudget)
+    {
+        const Entry entry = m_others.takeFirst();
+
+        QDir(entry.path).removeRecursively();
+        m_otherBytes -= entry.bytes;
+    }
+
+    return m_otherBytes + m_diskBytes + bytes <= m_diskBudget;
+}
@@ -0,0 +1,124 @@
+/**
+ * @brief Thumbnail Generator
+ * @anchor Ho 229
+ * @date 2023/5/17
+ */
+
+#ifndef THUMBNAILGENERATOR_H
+#define THUMBNAILGENERATOR_H
+
+#include <QSet>
+#include <QCache>
+#include <QImage>
+#include <QMutex>
+#include <QThread>
+#include <QVector>
+#include <QWaitCondition>
+
+struct AVFrame;
+struct AVStream;
+struct SwsContext;
+struct AVCodecContext;
+struct AVFormatContext;
+
+/**
+ * @brief Decode the key frames of a local file every THUMBNAIL_INTERVAL with its own
+ *        demuxer and decoder, the thumbnails are kept in a LRU cache and on the disk.
+ *        Each file has a directory on the disk, the least recently used ones are
+ *        evicted to keep all of them within the budget.
+ */
+class ThumbnailGenerator final : public QThread
+{
+    Q_OBJECT
+public:
+    explicit ThumbnailGenerator(QObject *parent = nullptr);
+    ~ThumbnailGenerator() Q_DECL_OVERRIDE;
+
+    /**
+     * @brief Start generating the thumbnails of the file
+     */
+    void load(const QString &fileName);
+
+    /**
+     * @brief Stop generating and drop the thumbnails in memory
+     */
+    void reset();
+
+    QString fileName() const;
+
+    /**
+     * @brief Budget of the thumbnails of all files on the disk, 0 disables the disk store,
+     *        it takes effect on the next load
+     */
+    void setDiskCacheSize(qint64 size);
+
+    /**
+     * @brief Get the thumbnail of the interval containing the time, it is generated
+     *        before the others if not available yet
+     * @param timeout in milliseconds
+     * @return null image if not available within the timeout
+     */
+    QImage thumbnail(qreal time, int timeout);
+
+private:
+    void run() Q_DECL_OVERRIDE;
+
+    bool openInput();
+    void closeInput();
+
+    QImage decode(int slot);
+    QImage toImage(const AVFrame *frame);
+
+    QString cacheFilePath(int slot) const;
+
+    struct Entry
+    {
+        QString path;
+        qint64 lastUsed;        // in milliseconds since epoch
+        qint64 bytes;
+    };
+
+    /**
+     * @brief Find the directories of the other files and mark the one of this file as used,
+     *        called by the generator thread
+     */
+    void openDiskCache();
+
+    /**
+     * @brief Save the thumbnail, nothing is saved once the directory alone exceeds the budget
+     */
+    void saveImage(const QString &filePath, const QImage &image);
+
+    /**
+     * @brief Remove the least recently used other directories until the bytes fit in the budget
+     * @return false if they do not fit even without the others
+     */
+    bool evict(qint64 bytes);
+
+    QString m_fileName;
+    QString m_cacheDir;
+    qint64 m_diskCacheSize = 0;
+
+    // Used by the generator thread only
+    qint64 m_diskBudget = 0;
+    qint64 m_diskBytes = 0;             // In the directory of this file
+    QVector<Entry> m_others;            // Ordered by lastUsed
+    qint64 m_otherBytes = 0;
+
+    AVFormatContext *m_formatContext = nullptr;
+    AVCodecContext *m_codecContext = nullptr;
+    SwsContext *m_swsContext = nullptr;
+    AVStream *m_stream = nullptr;
+
+    mutable QMutex m_mutex;
+    QWaitCondition m_requestCondition;
+    QWaitCondition m_generateCondition;
+
+    QCache<int, QImage> m_cache;        // Cost is the size in bytes
+    QSet<int> m_finishedSlots;          // Including the failed ones
+
+    int m_requestedSlot = -1;
+    int m_serial = 0;                   // Increased on every reset
+};
+
+#endif // THUMBNAILGENERATOR_H
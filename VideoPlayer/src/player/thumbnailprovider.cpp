@@ -0,0 +1,61 @@
+/**
+ * @brief Thumbnail Provider
+ * @anchor Ho 229
+ * @date 2023/5/17
+ */
+
+#include "config.h"
+#include "playerconfig.h"
+#include "thumbnailprovider.h"
+#include "thumbnailgenerator.h"
+
+#include <QUrl>
+
+ThumbnailProvider::ThumbnailProvider() :
+    QQuickImageProvider(QQuickImageProvider::Image),
+    m_generator(new ThumbnailGenerator)
+{
+    // Configured the same as the players, see also VideoPlayer::config
+    PlayerConfig config;
+    config.loadFile(qEnvironmentVariable("VIDEOPLAYER_CONFIG"));
+    config.loadEnvironment();
+
+    m_generator->setDiskCacheSize(config.thumbnailDiskCacheSize());
+}
+
+ThumbnailProvider::~ThumbnailProvider()
+{
+    delete m_generator;
+}
+
+QImage ThumbnailProvider::requestImage(const QString &id, QSize *size, const QSize &requestedSize)
+{
+    const int index = id.indexOf('/');
+    if(index < 0)
+        return {};
+
+    bool ok = false;
+    const qreal time = id.left(index).toDouble(&ok);
+    const QUrl url(QUrl::fromPercentEncoding(id.mid(index + 1).toUtf8()));
+
+    // A remote source would compete with the player for the bandwidth
+    if(!ok || !url.isLocalFile())
+        return {};
+
+    m_mutex.lock();
+
+    if(m_generator->fileName() != url.toLocalFile())
+        m_generator->load(url.toLocalFile());
+
+    m_mutex.unlock();
+
+    QImage image = m_generator->thumbnail(time, THUMBNAIL_WAIT_TIMEOUT);
+
+    if(size)
+        *size = image.size();
+
+    if(!image.isNull() && requestedSize.isValid())
+        image = image.scaled(requestedSize, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+
+    return image;
+}
@@ -0,0 +1,34 @@
+/**
+ * @brief Thumbnail Provider
+ * @anchor Ho 229
+ * @date 2023/5/17
+ */
+
+#ifndef THUMBNAILPROVIDER_H
+#define THUMBNAILPROVIDER_H
+
+#include <QMutex>
+#include <QQuickImageProvider>
+
+class ThumbnailGenerator;
+
+/**
+ * @brief Image provider of the seek bar previews, the id is
+ *        "<position in seconds>/<percent encoded url of the local file>",
+ *        eg. image://thumbnail/42/file%3A%2F%2F%2Fhome%2Fvideo.mp4
+ * @note Use it from an asynchronous Image, the request blocks until the thumbnail is generated
+ */
+class ThumbnailProvider final : public QQuickImageProvider
+{
+public:
+    ThumbnailProvider();
+    ~ThumbnailProvider() Q_DECL_OVERRIDE;
+
+    QImage requestImage(const QString &id, QSize *size, const QSize &requestedSize) Q_DECL_OVERRIDE;
+
+private:
+    QMutex m_mutex;
+    ThumbnailGenerator *m_generator = nullptr;
+};
+
+#endif // THUMBNAILPROVIDER_H
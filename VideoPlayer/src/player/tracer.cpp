@@ -0,0 +1,109 @@
+/**
+ * @brief Tracer
+ * @anchor Ho 229
+ * @date 2023/5/22
+ */
+
+#include "config.h"
+#include "tracer.h"
+
+#include <QDebug>
+#include <QThread>
+#include <QAtomicInt>
+#include <QMutexLocker>
+#include <QCoreApplication>
+
+Tracer *Tracer::instance()
+{
+    static Tracer tracer;
+    return &tracer;
+}
+
+Tracer::Tracer()
+{
+    const QString fileName = qEnvironmentVariable("VIDEOPLAYER_TRACE");
+    if(fileName.isEmpty())
+        return;
+
+    m_file.setFileName(fileName);
+    if(!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        qWarning() << __FUNCTION__ << ": Failed to open" << fileName;
+        return;
+    }
+
+    // JSON array format, the viewers accept it without the closing bracket
+    m_file.write("[\n");
+    m_timer.start();
+}
+
+Tracer::~Tracer()
+{
+    if(!m_file.isOpen())
+        return;
+
+    m_buffer += "\n]\n";
+    m_file.write(m_buffer);
+    m_file.close();
+}
+
+void Tracer::span(const char *name, qint64 start)
+{
+    this->write(name, 'X', start, this->now() - start);
+}
+
+void Tracer::instant(const char *name)
+{
+    this->write(name, 'i', this->now());
+}
+
+void Tracer::write(const char *name, char phase, qint64 start, qint64 duration)
+{
+    static QAtomicInt threadCount;
+    thread_local const int tid = threadCount.fetchAndAddRelaxed(1) + 1;
+    thread_local bool isThreadNamed = false;
+
+    QByteArray event;
+
+    // Name the track of the thread by its first event
+    if(!isThreadNamed)
+    {
+        const QThread *thread = QThread::currentThread();
+
+        QByteArray threadName = thread->objectName().toUtf8();
+        if(threadName.isEmpty())
+            threadName = QCoreApplication::instance() && thread == QCoreApplication::instance()->thread() ?
+                             "Main" : thread->metaObject()->className();
+
+        event += "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" + QByteArray::number(tid) +
+                 ",\"args\":{\"name\":\"" + threadName + "\"}},\n";
+
+        isThreadNamed = true;
+    }
+
+    // Timestamps in microseconds
+    event += "{\"name\":\"" + QByteArray(name) + "\",\"cat\":\"player\",\"ph\":\"" + phase +
+             "\",\"pid\":1,\"tid\":" + QByteArray::number(tid) +
+             ",\"ts\":" + QByteArray::number(start / 1000., 'f', 3);
+
+    if(phase == 'X')
+        event += ",\"dur\":" + QByteArray::number(duration / 1000., 'f', 3);
+    else if(phase == 'i')
+        event += ",\"s\":\"t\"";
+
+    event += '}';
+
+    QMutexLocker locker(&m_mutex);
+
+    if(m_hasEvents)
+        m_buffer += ",\n";
+
+    m_buffer += event;
+    m_hasEvents = true;
+
+    if(m_buffer.size() >= TRACE_BUFFER_SIZE)
+    {
+        m_file.write(m_buffer);
+        m_buffer.clear();
+    }
+}
@@ -0,0 +1,82 @@
+/**
+ * @brief Tracer
+ * @anchor Ho 229
+ * @date 2023/5/22
+ */
+
+#ifndef TRACER_H
+#define TRACER_H
+
+#include <QFile>
+#include <QMutex>
+#include <QElapsedTimer>
+
+/**
+ * @brief Spans of the pipeline stages written in the Chrome Trace Event format,
+ *        enabled by the environment variable VIDEOPLAYER_TRACE=<output file>.
+ *        Open the file in chrome://tracing or https://ui.perfetto.dev
+ * @note Thread safe, the file is complete after the process exits normally
+ *       but the viewers take a truncated one too
+ */
+class Tracer final
+{
+public:
+    static Tracer *instance();
+
+    static bool isEnabled() { return instance()->m_file.isOpen(); }
+
+    /**
+     * @return time since the tracer started, in nanoseconds
+     */
+    qint64 now() const { return m_timer.nsecsElapsed(); }
+
+    void span(const char *name, qint64 start);
+    void instant(const char *name);
+
+private:
+    Tracer();
+    ~Tracer();
+
+    Q_DISABLE_COPY(Tracer)
+
+    void write(const char *name, char phase, qint64 start, qint64 duration = 0);
+
+    QFile m_file;
+    QMutex m_mutex;
+    QElapsedTimer m_timer;
+
+    QByteArray m_buffer;        // Flushed every TRACE_BUFFER_SIZE
+    bool m_hasEvents = false;
+};
+
+/**
+ * @brief Trace the scope of the object, nothing but a check if the tracer is disabled
+ */
+class TraceSpan final
+{
+public:
+    explicit TraceSpan(const char *name) :
+        m_name(Tracer::isEnabled() ? name : nullptr),
+        m_start(m_name ? Tracer::instance()->now() : 0)
+    {}
+
+    ~TraceSpan()
+    {
+        if(m_name)
+            Tracer::instance()->span(m_name, m_start);
+    }
+
+private:
+    Q_DISABLE_COPY(TraceSpan)
+
+    const char *const m_name;
+    const qint64 m_start;
+};
+
+#define TRACE_CONCAT_(a, b) a ## b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+
+#define TRACE_SCOPE(name) const TraceSpan TRACE_CONCAT(traceSpan, __LINE__)(name)
+#define TRACE_INSTANT(name) do { if(Tracer::isEnabled()) Tracer::instance()->instant(name); } while(false)
+
+#endif // TRACER_H
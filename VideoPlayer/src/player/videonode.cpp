@@ -0,0 +1,107 @@
+/**
+ * @brief Video Node
+ * @anchor Ho 229
+ * @date 2023/5/19
+ */
+
+#include "videonode.h"
+
+#include <QSGMaterial>
+#include <QOpenGLShaderProgram>
+
+class VideoMaterial final : public QSGMaterial
+{
+public:
+    explicit VideoMaterial(VideoTexture *texture) : m_texture(texture) {}
+
+    VideoTexture *texture() const { return m_texture; }
+
+    QSGMaterialType *type() const override
+    {
+        static QSGMaterialType type;
+        return &type;
+    }
+
+    QSGMaterialShader *createShader() const override;
+
+    int compare(const QSGMaterial *other) const override
+    {
+        const VideoTexture *otherTexture = static_cast<const VideoMaterial *>(other)->texture();
+        return m_texture == otherTexture ? 0 : (m_texture < otherTexture ? -1 : 1);
+    }
+
+private:
+    VideoTexture *const m_texture;
+};
+
+class VideoMaterialShader final : public QSGMaterialShader
+{
+    int m_matrixLocation = -1;
+public:
+    VideoMaterialShader()
+    {
+        this->setShaderSourceFile(QOpenGLShader::Vertex, ":/videonode.vsh");
+        this->setShaderSourceFile(QOpenGLShader::Fragment, ":/fragment.fsh");
+    }
+
+    char const *const *attributeNames() const override
+    {
+        // Same as the locations in videonode.vsh
+        static const char *const names[] = { "vertex", "texCoord", nullptr };
+        return names;
+    }
+
+    void initialize() override
+    {
+        m_matrixLocation = this->program()->uniformLocation("qt_Matrix");
+    }
+
+    void updateState(const RenderState &state, QSGMaterial *newMaterial, QSGMaterial *) override
+    {
+        if(state.isMatrixDirty())
+            this->program()->setUniformValue(m_matrixLocation, state.combinedMatrix());
+
+        VideoTexture *texture = static_cast<VideoMaterial *>(newMaterial)->texture();
+
+        // The scene graph is rendering, the GUI thread is not blocked
+        texture->upload();
+        texture->setUniforms(this->program());
+        texture->bind();
+    }
+};
+
+QSGMaterialShader *VideoMaterial::createShader() const
+{
+    return new VideoMaterialShader;
+}
+
+VideoNode::VideoNode()
+{
+    this->setGeometry(new QSGGeometry(QSGGeometry::defaultAttributes_TexturedPoint2D(), 4));
+    this->setMaterial(new VideoMaterial(&m_texture));
+    this->setFlags(QSGNode::OwnsGeometry | QSGNode::OwnsMaterial);
+}
+
+void VideoNode::synchronize(const QRectF &rect)
+{
+    // The uniforms are set on every draw
+    m_texture.synchronize();
+
+    QRectF viewRect;
+    if(m_texture.isCreated())
+    {
+        viewRect.setSize(QSizeF(m_texture.videoSize()).scaled(rect.size(), Qt::KeepAspectRatio));
+        viewRect.moveCenter(rect.center());
+    }
+
+    if(viewRect != m_viewRect)
+    {
+        // Row 0 of the frame is the top
+        QSGGeometry::updateTexturedRectGeometry(this->geometry(), viewRect, QRectF(0, 0, 1, 1));
+        this->markDirty(QSGNode::DirtyGeometry);
+
+        m_viewRect = viewRect;
+    }
+
+    this->markDirty(QSGNode::DirtyMaterial);
+}
@@ -0,0 +1,37 @@
+/**
+ * @brief Video Node
+ * @anchor Ho 229
+ * @date 2023/5/19
+ */
+
+#ifndef VIDEONODE_H
+#define VIDEONODE_H
+
+#include "videotexture.h"
+
+#include <QSGGeometryNode>
+
+/**
+ * @brief Scene graph node drawing the video frame as a textured quad,
+ *        its material samples the frame textures with fragment.fsh directly
+ *        instead of going through a framebuffer object
+ */
+class VideoNode final : public QSGGeometryNode
+{
+public:
+    VideoNode();
+
+    VideoTexture *texture() { return &m_texture; }
+
+    /**
+     * @brief Take the handed over frames and fit the video in the rect,
+     *        called in QQuickItem::updatePaintNode()
+     */
+    void synchronize(const QRectF &rect);
+
+private:
+    VideoTexture m_texture;
+    QRectF m_viewRect;
+};
+
+#endif // VIDEONODE_H
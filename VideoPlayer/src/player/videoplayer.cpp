@@ -4,12 +4,15 @@
  * @date 2021/4/14
  */
 
+#include "config.h"
 #include "audiooutput.h"
 #include "videoplayer.h"
+#include "videonode.h"
 #include "videoplayer_p.h"
 #include "videorenderer.h"
 
 #include <QThread>
+#include <QSGSimpleRectNode>
 #include <QEventLoop>
 #include <QMetaObject>
 #include <QTimerEvent>
@@ -20,8 +23,13 @@ VideoPlayer::VideoPlayer(QQuickItem *parent) :
 {
     Q_D(VideoPlayer);
 
+    d->config = new PlayerConfig(this);
+    d->config->loadFile(qEnvironmentVariable("VIDEOPLAYER_CONFIG"));
+    d->config->loadEnvironment();
+
     d->decoder = new FFmpegDecoder(nullptr);
     d->decoder->moveToThread(new QThread(this));
+    d->decoder->thread()->setObjectName("Demuxer");
     d->decoder->thread()->start();
 
     d->audioOutput = new AudioOutput([d](char *data, qint64 maxlen)
@@ -36,6 +44,19 @@ VideoPlayer::VideoPlayer(QQuickItem *parent) :
 
     QObject::connect(d->decoder, &FFmpegDecoder::activeAudioTrackChanged,
                      this, [this] { d_ptr->restartAudioOutput(); });
+
+    QObject::connect(d->decoder, &FFmpegDecoder::seeked,
+                     this, [this](int position, int serial) { d_ptr->onSeeked(position, serial); });
+
+    // The load runs on the decoder thread, see also VideoPlayer::play()
+    QObject::connect(d->decoder, &FFmpegDecoder::stateChanged,
+                     this, [this](FFmpegDecoder::State state) { d_ptr->onDecoderStateChanged(state); });
+    QObject::connect(d->decoder, &FFmpegDecoder::tracksFound,
+                     this, [this] { d_ptr->onTracksFound(); });
+
+    // The video frames are presented on the vblanks of the window
+    QObject::connect(this, &QQuickItem::windowChanged,
+                     this, [this](QQuickWindow *window) { d_ptr->setWindow(window); });
 }
 
 VideoPlayer::~VideoPlayer()
@@ -52,14 +73,70 @@ VideoPlayer::~VideoPlayer()
     if(!d->decoder->thread()->wait())
         FUNC_ERROR << ": Decode thread exit failed";
 
+    // Stop presenting on the render thread
+    d->setWindow(nullptr);
+
     // Delete the VideoPlayerPrivate
     delete d;
 }
 
 QQuickFramebufferObject::Renderer *VideoPlayer::createRenderer() const
 {
-    d_ptr->videoRenderer = new VideoRenderer;
-    return d_ptr->videoRenderer;    // Create custom renderer
+    VideoRenderer *renderer = new VideoRenderer;
+    renderer->texture()->setFramePool(d_ptr->decoder->framePool());
+
+    d_ptr->videoTexture = renderer->texture();
+    d_ptr->videoRenderer = renderer;
+    return renderer;    // Create custom renderer
+}
+
+void VideoPlayer::setRenderMode(RenderMode mode)
+{
+    Q_D(VideoPlayer);
+
+    if(d->renderMode == mode)
+        return;
+
+    // The node of the other mode has been created
+    if(d->videoTexture)
+    {
+        qWarning() << __FUNCTION__ << ": The render mode can not be changed after shown.";
+        return;
+    }
+
+    d->renderMode = mode;
+    emit renderModeChanged(mode);
+}
+
+VideoPlayer::RenderMode VideoPlayer::renderMode() const
+{
+    return d_ptr->renderMode;
+}
+
+QSGNode *VideoPlayer::updatePaintNode(QSGNode *oldNode, UpdatePaintNodeData *data)
+{
+    Q_D(VideoPlayer);
+
+    if(d->renderMode == FramebufferRendering)
+        return QQuickFramebufferObject::updatePaintNode(oldNode, data);
+
+    // Called on the render thread while the GUI thread is blocked
+    QSGSimpleRectNode *background = static_cast<QSGSimpleRectNode *>(oldNode);
+    if(!background)
+    {
+        VideoNode *node = new VideoNode;
+        node->texture()->setFramePool(d->decoder->framePool());
+
+        background = new QSGSimpleRectNode(QRectF(), Qt::black);
+        background->appendChildNode(node);
+
+        d->videoTexture = node->texture();
+    }
+
+    background->setRect(this->boundingRect());
+    static_cast<VideoNode *>(background->firstChild())->synchronize(this->boundingRect());
+
+    return background;
 }
 
 void VideoPlayer::setSource(const QUrl& source)
@@ -80,6 +157,11 @@ VideoPlayer::State VideoPlayer::playbackState() const
     return d_ptr->state;
 }
 
+VideoPlayer::Status VideoPlayer::status() const
+{
+    return d_ptr->status;
+}
+
 void VideoPlayer::play()
 {
     Q_D(VideoPlayer);
@@ -88,32 +170,25 @@ void VideoPlayer::play()
         return;
     else if(d->state == Stopped && d->decoder->state() == FFmpegDecoder::Closed)
     {
-        QEventLoop loop;
-        QObject::connect(d->decoder, &FFmpegDecoder::stateChanged, &loop, &QEventLoop::exit);
-        QMetaObject::invokeMethod(d->decoder, &FFmpegDecoder::load, Qt::QueuedConnection);
+        d->decoder->setConfig(d->config);
+        d->audioOutput->setBufferSize(d->config->audioBufferSize());
+        d->audioLatency = d->config->audioLatency();
 
-        if(loop.exec() != FFmpegDecoder::Opened)
-        {
-            emit errorOccurred(this->errorString());
-            return;
-        }
-
-        emit loaded();
-
-        const auto fps = d->decoder->fps();
-        d->interval = qIsNaN(fps) ? 1000.0 : 1000 / fps;
+        // Returns immediately, see also VideoPlayerPrivate::onDecoderStateChanged()
+        d->setStatus(Loading);
+        d->decoder->requestLoad();
     }
-    else if(d->state == Paused)
+    else if(d->state == Paused && d->status == Ready)
     {
         d->videoClock.resume();
         d->audioClock.resume();
     }
 
-    d->timerId = this->startTimer(d->interval, Qt::PreciseTimer);
-    d->audioOutput->play();
-
     d->state = Playing;
     emit playbackStateChanged(Playing);
+
+    if(d->status == Ready)
+        d->startPresentation();
 }
 
 void VideoPlayer::pause()
@@ -123,11 +198,21 @@ void VideoPlayer::pause()
     if(d->state != Playing)
         return;
 
-    this->killTimer(d->timerId);
-    d->audioOutput->pause();
+    // Nothing is presented yet while loading
+    if(d->status == Ready)
+    {
+        if(d->timerId >= 0)
+        {
+            this->killTimer(d->timerId);
+            d->timerId = -1;
+        }
 
-    d->videoClock.pause();
-    d->audioClock.pause();
+        d->audioOutput->pause();
+
+        d->videoClock.pause();
+        d->audioClock.pause();
+        d->driftTimer.invalidate();
+    }
 
     d->state = Paused;
     emit playbackStateChanged(Paused);
@@ -139,28 +224,67 @@ void VideoPlayer::stop()
 
     if(d->state == Stopped)
         return;
-    else if(d->state == Playing)
+    else if(d->timerId >= 0)
+    {
         this->killTimer(d->timerId);
+        d->timerId = -1;
+    }
+
+    if(d->seekTimerId >= 0)
+    {
+        this->killTimer(d->seekTimerId);
+        d->seekTimerId = -1;
+    }
+
+    if(d->statsTimerId >= 0)
+    {
+        this->killTimer(d->statsTimerId);
+        d->statsTimerId = -1;
+    }
+
+    d->seekTarget = -1;
+    d->isWaitingSeekFrame = false;
 
     d->audioOutput->stop();
 
+    // The end of an aborted load is ignored from now on
+    d->hasTracks = false;
+    d->setStatus(Unloaded);
+
+    // Also aborts the load, the release is queued after it if it has not started yet
     d->decoder->requestInterrupt();
     QEventLoop loop;
-    QObject::connect(d->decoder, &FFmpegDecoder::stateChanged, &loop, &QEventLoop::quit);
-    QMetaObject::invokeMethod(d->decoder, &FFmpegDecoder::release, Qt::QueuedConnection);
+    QMetaObject::invokeMethod(d->decoder, [decoder = d->decoder, &loop] {
+        decoder->release();
+        QMetaObject::invokeMethod(&loop, &QEventLoop::quit, Qt::QueuedConnection);
+    }, Qt::QueuedConnection);
     loop.exec();
 
+    d->clearPendingFrame();
+    d->decoder->clearFrames();
+
     av_frame_free(&d->audioFrame);
     d->audioFramePos = 0;
 
     d->videoClock.invalidate();
     d->audioClock.invalidate();
-    d->videoRenderer->updateSubtitleFrame(nullptr);
+    if(d->videoTexture)
+        d->videoTexture->updateSubtitleFrame(nullptr);
+
+    d->audioCompensation = 0;
+    d->decoder->setAudioCompensation(0);
+
+    // The decoder has reset its frame drop level in release()
+    d->frameDropLevel = FFmpegDecoder::NoFrameDrop;
+    d->frameDropTimer.invalidate();
+    d->droppedFrames.storeRelaxed(0);
+    d->resetStats();
 
     d->position = 0;
     emit positionChanged(0);
 
-    d->videoRenderer->updateVideoFrame(nullptr);
+    if(d->videoTexture)
+        d->videoTexture->updateVideoFrame(nullptr);
     this->update();
 
     d->state = Stopped;
@@ -179,11 +303,34 @@ qreal VideoPlayer::volume() const
     return d_ptr->audioOutput->volume();
 }
 
+void VideoPlayer::setPlaybackRate(qreal rate)
+{
+    Q_D(VideoPlayer);
+
+    rate = qBound(MIN_PLAYBACK_RATE, rate, MAX_PLAYBACK_RATE);
+    if(qFuzzyCompare(rate, d->playbackRate))
+        return;
+
+    // The clocks follow on the next frame, see also VideoPlayerPrivate::presentVideoFrame()
+    d->playbackRate = rate;
+    d->decoder->setPlaybackRate(rate);
+
+    // The drift is measured at one rate
+    d->driftTimer.invalidate();
+
+    emit playbackRateChanged(rate);
+}
+
+qreal VideoPlayer::playbackRate() const
+{
+    return d_ptr->playbackRate;
+}
+
 void VideoPlayer::setActiveVideoTrack(int index)
 {
     Q_D(VideoPlayer);
 
-    if(!this->hasVideo() || d->decoder->activeVideoTrack() == index)
+    if(d->status != Ready || !this->hasVideo() || d->decoder->activeVideoTrack() == index)
         return;
 
     d->decoder->requestInterrupt();
@@ -195,9 +342,12 @@ void VideoPlayer::setActiveVideoTrack(int index)
     av_frame_free(&d->audioFrame);
     d->audioFramePos = 0;
 
+    d->clearPendingFrame();
+
     d->videoClock.invalidate();
     d->audioClock.invalidate();
-    d->videoRenderer->updateSubtitleFrame(nullptr);
+    if(d->videoTexture)
+        d->videoTexture->updateSubtitleFrame(nullptr);
 }
 
 int VideoPlayer::activeVideoTrack() const
@@ -209,7 +359,7 @@ void VideoPlayer::setActiveAudioTrack(int index)
 {
     Q_D(VideoPlayer);
 
-    if(!this->hasAudio() || d->decoder->activeAudioTrack() == index)
+    if(d->status != Ready || !this->hasAudio() || d->decoder->activeAudioTrack() == index)
         return;
 
     d->decoder->requestInterrupt();
@@ -219,9 +369,12 @@ void VideoPlayer::setActiveAudioTrack(int index)
     av_frame_free(&d->audioFrame);
     d->audioFramePos = 0;
 
+    d->clearPendingFrame();
+
     d->videoClock.invalidate();
     d->audioClock.invalidate();
-    d->videoRenderer->updateSubtitleFrame(nullptr);
+    if(d->videoTexture)
+        d->videoTexture->updateSubtitleFrame(nullptr);
 }
 
 int VideoPlayer::activeAudioTrack() const
@@ -233,7 +386,7 @@ void VideoPlayer::setActiveSubtitleTrack(int index)
 {
     Q_D(VideoPlayer);
 
-    if(!this->hasSubtitle() || d->decoder->activeSubtitleTrack() == index)
+    if(d->status != Ready || !this->hasSubtitle() || d->decoder->activeSubtitleTrack() == index)
         return;
 
     d->decoder->requestInterrupt();
@@ -245,9 +398,12 @@ void VideoPlayer::setActiveSubtitleTrack(int index)
     av_frame_free(&d->audioFrame);
     d->audioFramePos = 0;
 
+    d->clearPendingFrame();
+
     d->videoClock.invalidate();
     d->audioClock.invalidate();
-    d->videoRenderer->updateSubtitleFrame(nullptr);
+    if(d->videoTexture)
+        d->videoTexture->updateSubtitleFrame(nullptr);
 }
 
 int VideoPlayer::activeSubtitleTrack() const
@@ -255,24 +411,55 @@ int VideoPlayer::activeSubtitleTrack() const
     return d_ptr->decoder->activeSubtitleTrack();
 }
 
+PlayerConfig *VideoPlayer::config() const
+{
+    return d_ptr->config;
+}
+
+PlayerConfig::ThreadingMode VideoPlayer::activeThreadingMode() const
+{
+    return static_cast<PlayerConfig::ThreadingMode>(d_ptr->decoder->activeThreadingMode());
+}
+
+qint64 VideoPlayer::residentBytes() const
+{
+    return d_ptr->decoder->residentBytes();
+}
+
+int VideoPlayer::droppedFrames() const
+{
+    return d_ptr->droppedFrames.loadRelaxed();
+}
+
+int VideoPlayer::skippedFrames() const
+{
+    return d_ptr->decoder->skippedFrames();
+}
+
+QVariantMap VideoPlayer::stats() const
+{
+    return d_ptr->stats;
+}
+
+// The tracks are being found by the decoder thread until VideoPlayer::loaded()
 int VideoPlayer::videoTrackCount() const
 {
-    return d_ptr->decoder->videoTrackCount();
+    return d_ptr->hasTracks ? d_ptr->decoder->videoTrackCount() : 0;
 }
 
 int VideoPlayer::audioTrackCount() const
 {
-    return d_ptr->decoder->audioTrackCount();
+    return d_ptr->hasTracks ? d_ptr->decoder->audioTrackCount() : 0;
 }
 
 int VideoPlayer::subtitleTrackCount() const
 {
-    return d_ptr->decoder->subtitleTrackCount();
+    return d_ptr->hasTracks ? d_ptr->decoder->subtitleTrackCount() : 0;
 }
 
 int VideoPlayer::duration() const
 {
-    return d_ptr->decoder->duration();
+    return d_ptr->hasTracks ? d_ptr->decoder->duration() : 0;
 }
 
 int VideoPlayer::position() const
@@ -282,17 +469,17 @@ int VideoPlayer::position() const
 
 bool VideoPlayer::hasVideo() const
 {
-    return d_ptr->decoder->videoTrackCount();
+    return this->videoTrackCount();
 }
 
 bool VideoPlayer::hasAudio() const
 {
-    return d_ptr->decoder->audioTrackCount();
+    return this->audioTrackCount();
 }
 
 bool VideoPlayer::hasSubtitle() const
 {
-    return d_ptr->decoder->subtitleTrackCount();
+    return this->subtitleTrackCount();
 }
 
 bool VideoPlayer::seekable() const
@@ -305,57 +492,52 @@ QString VideoPlayer::errorString() const
     return d_ptr->decoder->errorString();
 }
 
-void VideoPlayer::seek(int position)
+void VideoPlayer::seek(int position, bool isPreview)
 {
     Q_D(VideoPlayer);
 
-    if(d->position == position || d->state == State::Stopped || !this->seekable())
+    if(d->status != Ready || !this->seekable())
         return;
 
     d->position = position;
     emit positionChanged(position);
 
-    d->decoder->requestInterrupt();
-    QMetaObject::invokeMethod(d->decoder, "seek", Qt::BlockingQueuedConnection, Q_ARG(int, position));
-
-    d->audioOutput->reset();
+    d->seekTarget = position;
+    d->isWaitingSeekFrame = false;
 
-    av_frame_free(&d->audioFrame);
-    d->audioFramePos = 0;
+    // Returns immediately, see also VideoPlayerPrivate::onSeeked()
+    d->seekSerial = d->decoder->requestSeek(position, !isPreview);
+}
 
-    d->videoClock.invalidate();
-    d->audioClock.invalidate();
-    d->videoRenderer->updateSubtitleFrame(nullptr);
+void VideoPlayer::timerEvent(QTimerEvent *event)
+{
+    Q_D(VideoPlayer);
 
-    if(d->state == Paused)
+    if(event->timerId() == d->statsTimerId)
     {
-        AVFrame *frame = nullptr;
-        while(!(frame = d->decoder->takeVideoFrame()))
-            QThread::yieldCurrentThread();
-
-        d->videoRenderer->updateVideoFrame(frame);
-        this->update();
+        d->updateStats();
+        return;
     }
-}
 
-void VideoPlayer::timerEvent(QTimerEvent *)
-{
-    Q_D(VideoPlayer);
+    const bool hasVideo = !qIsNaN(d->decoder->fps());
 
-    d->updateVideoFrame();
-    d->updateSubtitleFrame();
-    this->update();
+    // Presented by the window while it renders, see also VideoPlayerPrivate::onFrameSwapped()
+    if(event->timerId() == d->timerId && hasVideo && !d->isRenderStalled())
+        return;
 
-    if(d->videoClock.isValid() || d->audioClock.isValid())
+    // Keep the current frame until the pending seek is done
+    if(d->seekTarget >= 0)
+        return;
+
+    if(d->isWaitingSeekFrame)
     {
-        const int position = d->videoClock.isValid() ? d->videoClock.time() : d->audioClock.time();
-        if(position != d->position)
-        {
-            d->position = position;
-            emit positionChanged(position);
-        }
+        d->updateSeekFrame();
+        return;
     }
 
-    if(!d->decoder->hasFrame() && d->decoder->isEnd())
-        this->stop();
+    // Playback without video, or the window does not render, eg. minimized
+    if(hasVideo)
+        d->presentWithoutWindow();
+
+    d->updatePosition();
 }
@@ -9,6 +9,8 @@
 
 #include <QQuickFramebufferObject>
 
+#include "playerconfig.h"
+
 class VideoPlayerPrivate;
 
 class VideoPlayer : public QQuickFramebufferObject
@@ -17,16 +19,27 @@ class VideoPlayer : public QQuickFramebufferObject
 
     Q_PROPERTY(QUrl source READ source WRITE setSource NOTIFY sourceChanged)
     Q_PROPERTY(qreal volume READ volume WRITE setVolume NOTIFY volumeChanged)
+    Q_PROPERTY(qreal playbackRate READ playbackRate WRITE setPlaybackRate NOTIFY playbackRateChanged)
 
     Q_PROPERTY(int activeVideoTrack READ activeVideoTrack WRITE setActiveVideoTrack NOTIFY activeVideoTrackChanged)
     Q_PROPERTY(int activeAudioTrack READ activeAudioTrack WRITE setActiveAudioTrack NOTIFY activeAudioTrackChanged)
     Q_PROPERTY(int activeSubtitleTrack READ activeSubtitleTrack WRITE setActiveSubtitleTrack NOTIFY activeSubtitleTrackChanged)
 
+    // Property group, takes effect on the next load
+    Q_PROPERTY(PlayerConfig *config READ config CONSTANT)
+
     // Read only property
     Q_PROPERTY(int position READ position NOTIFY positionChanged)
 
+    // Sampled every PlayerConfig::statsInterval
+    Q_PROPERTY(QVariantMap stats READ stats NOTIFY statsChanged)
+    Q_PROPERTY(qint64 residentBytes READ residentBytes NOTIFY statsChanged)
+    Q_PROPERTY(int droppedFrames READ droppedFrames NOTIFY statsChanged)
+    Q_PROPERTY(int skippedFrames READ skippedFrames NOTIFY statsChanged)
+
     Q_PROPERTY(QString errorString READ errorString NOTIFY errorOccurred)
     Q_PROPERTY(State playbackState READ playbackState NOTIFY playbackStateChanged)
+    Q_PROPERTY(Status status READ status NOTIFY statusChanged)
 
     Q_PROPERTY(int duration READ duration NOTIFY loaded)
 
@@ -40,6 +53,11 @@ class VideoPlayer : public QQuickFramebufferObject
     Q_PROPERTY(int audioTrackCount READ audioTrackCount NOTIFY loaded)
     Q_PROPERTY(int subtitleTrackCount READ subtitleTrackCount NOTIFY loaded)
 
+    Q_PROPERTY(PlayerConfig::ThreadingMode activeThreadingMode READ activeThreadingMode NOTIFY activeVideoTrackChanged)
+
+    // Set it before the item is shown, it can not be changed afterwards
+    Q_PROPERTY(RenderMode renderMode READ renderMode WRITE setRenderMode NOTIFY renderModeChanged)
+
 public:
     enum State
     {
@@ -49,19 +67,46 @@ public:
     };
     Q_ENUM(State)
 
+    // Of the media, the playback state is kept while loading
+    enum Status
+    {
+        Unloaded,
+        Loading,        // The tracks are known once VideoPlayer::loaded() is emitted
+        Ready           // Being presented
+    };
+    Q_ENUM(Status)
+
+    enum RenderMode
+    {
+        FramebufferRendering,   // Render into a multisampled framebuffer object first
+        SceneGraphRendering     // Draw a scene graph node sampling the frame textures directly
+    };
+    Q_ENUM(RenderMode)
+
     VideoPlayer(QQuickItem *parent = nullptr);
     virtual ~VideoPlayer() Q_DECL_OVERRIDE;
 
     Renderer *createRenderer() const Q_DECL_OVERRIDE;
 
+    void setRenderMode(RenderMode mode);
+    RenderMode renderMode() const;
+
     void setSource(const QUrl& source);
     QUrl source() const;
 
     State playbackState() const;
+    Status status() const;
 
     void setVolume(qreal volume);
     qreal volume() const;
 
+    /**
+     * @brief Set the speed of the playback, the pitch of the audio is kept.
+     *        It is bounded to [MIN_PLAYBACK_RATE, MAX_PLAYBACK_RATE] and kept across the sources.
+     */
+    void setPlaybackRate(qreal rate);
+    qreal playbackRate() const;
+
     void setActiveVideoTrack(int index);
     int activeVideoTrack() const;
 
@@ -71,6 +116,41 @@ public:
     void setActiveSubtitleTrack(int index);
     int activeSubtitleTrack() const;
 
+    /**
+     * @brief Initialized from the file named by the environment variable VIDEOPLAYER_CONFIG,
+     *        then from the environment variables, see also PlayerConfig::loadEnvironment()
+     */
+    PlayerConfig *config() const;
+
+    PlayerConfig::ThreadingMode activeThreadingMode() const;
+
+    /**
+     * @return memory held by the decoded frame caches, in bytes
+     */
+    qint64 residentBytes() const;
+
+    /**
+     * @return count of the frames decoded but too late to be shown
+     */
+    int droppedFrames() const;
+
+    /**
+     * @return count of the frames not decoded by the frame drop of the decoder
+     */
+    int skippedFrames() const;
+
+    /**
+     * @brief Counters of the pipeline for a debug overlay or the telemetry,
+     *        updated every PlayerConfig::statsInterval from the load until stopped:
+     *        decodedFrames, presentedFrames, droppedFrames, skippedFrames,
+     *        videoCache and audioCache { frames, seconds, bytes }, residentBytes,
+     *        avOffset and frameLateness in seconds, frameDropLevel,
+     *        decodeMsPerFrame and uploadMsPerFrame averaged since the last update,
+     *        threadingMode, conversion ("native" or "sws") and networkBuffer
+     *        { bytes, seconds, capacity, underruns, cachedBytes, isAtEnd } of the buffered network streams
+     */
+    QVariantMap stats() const;
+
     int videoTrackCount() const;
     int audioTrackCount() const;
     int subtitleTrackCount() const;
@@ -89,25 +169,45 @@ public:
 
     QString errorString() const;
 
+    /**
+     * @brief The media is loaded asynchronously from VideoPlayer::Stopped,
+     *        it is presented once the status is VideoPlayer::Ready
+     */
     Q_INVOKABLE void play();
     Q_INVOKABLE void pause();
     Q_INVOKABLE void stop();
 
-    Q_INVOKABLE void seek(int position);
+    /**
+     * @brief Asynchronous seek, a burst of calls is coalesced into the latest one
+     * @param isPreview show the key frame before the position, it is fast enough for
+     *        dragging. Otherwise seek to the exact frame, see also PlayerConfig::seekMode.
+     */
+    Q_INVOKABLE void seek(int position, bool isPreview = false);
 
 signals:
     void errorOccurred(QString);
 
+    // The tracks and the duration are known, emitted while loading
     void loaded();
     void sourceChanged(QUrl);
     void playbackStateChanged(VideoPlayer::State);
+    void statusChanged(VideoPlayer::Status);
     void volumeChanged(qreal);
+    void playbackRateChanged(qreal);
     void positionChanged(int);
+    void statsChanged();
+
+    void seekCompleted(int position);
 
     void activeVideoTrackChanged(int);
     void activeAudioTrackChanged(int);
     void activeSubtitleTrackChanged(int);
 
+    void renderModeChanged(VideoPlayer::RenderMode);
+
+protected:
+    QSGNode *updatePaintNode(QSGNode *oldNode, UpdatePaintNodeData *data) Q_DECL_OVERRIDE;
+
 private:
     VideoPlayerPrivate *const d_ptr;
     Q_DECLARE_PRIVATE(VideoPlayer)
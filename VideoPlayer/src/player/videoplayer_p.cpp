@@ -4,20 +4,17 @@
  * @date 2023/4/21
  */
 
+#include "config.h"
+#include "tracer.h"
 #include "videoplayer_p.h"
 
 #include "audiooutput.h"
-#include "ffmpegdecoder.h"
+#include "videotexture.h"
 #include "videorenderer.h"
+#include "networkinput.h"
+#include "ffmpegdecoder.h"
 
-void VideoPlayerPrivate::updateTimer(int newInterval)
-{
-    Q_Q(VideoPlayer);
-
-    interval = newInterval;
-    q->killTimer(timerId);
-    q->startTimer(interval, Qt::PreciseTimer);
-}
+#include <QMetaEnum>
 
 void VideoPlayerPrivate::restartAudioOutput()
 {
@@ -29,12 +26,23 @@ void VideoPlayerPrivate::restartAudioOutput()
 
 qint64 VideoPlayerPrivate::updateAudioData(char *data, qint64 maxlen)
 {
+    TRACE_SCOPE("audioData");
+
     if(!data)
         return 0;
 
+    // Silence until the pending seek is done
+    if(seekTarget >= 0)
+    {
+        memset(data, 0, size_t(maxlen));
+        return maxlen;
+    }
+
     qint64 free = maxlen;
     char *dest = data;
 
+    qreal endPts = -1, byteRate = 0, speed = 1;
+
     while(free)
     {
         if(!audioFrame)
@@ -43,9 +51,6 @@ qint64 VideoPlayerPrivate::updateAudioData(char *data, qint64 maxlen)
                 break;
         }
 
-        if(!audioClock.isValid() || (audioOutput->isLowDataLeft() && dest == data))
-            audioClock.update(FFmpegDecoder::framePts(audioFrame));
-
         const auto size = qMin(qint64(audioFrame->linesize[0]) - audioFramePos, free);
 
         memcpy(dest, audioFrame->data[0] + audioFramePos, size);
@@ -53,49 +58,521 @@ qint64 VideoPlayerPrivate::updateAudioData(char *data, qint64 maxlen)
         free -= size;
         audioFramePos += size;
 
+        // Pts of the end of the written data
+        const qreal pts = FFmpegDecoder::framePts(audioFrame);
+        byteRate = qreal(audioFrame->sample_rate) * audioFrame->ch_layout.nb_channels *
+                   av_get_bytes_per_sample(static_cast<AVSampleFormat>(audioFrame->format));
+
+        // Seconds of the media per second played, not 1 if time stretched
+        const qreal duration = FFmpegDecoder::frameDuration(audioFrame);
+        speed = duration > 0 && byteRate > 0 ? duration * byteRate / audioFrame->linesize[0] : 1;
+
+        if(!qFuzzyCompare(pts, -1) && byteRate > 0)
+            endPts = pts + audioFramePos / byteRate * speed;
+
         if(audioFramePos >= audioFrame->linesize[0])
         {
             audioFramePos = 0;
-            av_frame_free(&audioFrame);
+            decoder->framePool()->recycle(audioFrame);
+            audioFrame = nullptr;
         }
     }
 
+    // The data written now is played after the queued one
+    if(endPts >= 0)
+    {
+        audioClock.setRate(speed);
+        this->updateAudioClock(endPts - ((maxlen - free) / byteRate +
+                                         audioOutput->queuedDuration() + audioLatency) * speed);
+    }
+
     return maxlen - free;
 }
 
-void VideoPlayerPrivate::updateVideoFrame()
+void VideoPlayerPrivate::updateAudioClock(qreal time)
 {
-    AVFrame *frame = nullptr;
-    while((frame = decoder->takeVideoFrame()))
+    // Smooth the jitter of the callbacks, follow a jump directly, eg. an underrun
+    if(!audioClock.isValid() || qAbs(time - audioClock.time()) > AV_RESYNC_THRESHOLD)
+        audioClock.update(time);
+    else
+        audioClock.adjust((time - audioClock.time()) / AUDIO_CLOCK_SMOOTHING);
+}
+
+void VideoPlayerPrivate::syncVideoClock()
+{
+    if(!audioClock.isValid())
+        return;
+
+    const qreal diff = audioClock.time() - videoClock.time();
+    if(qAbs(diff) > AV_RESYNC_THRESHOLD)
     {
-        const qreal pts = FFmpegDecoder::framePts(frame);
-        if(!qFuzzyCompare(pts, -1))
-        {
-            videoClock.update(pts);
-            auto nextInterval = FFmpegDecoder::frameDuration(frame);
+        videoClock.update(audioClock.time());
+        return;
+    }
 
-            if(audioClock.isValid())
-                nextInterval -= audioClock.time() - videoClock.time()/* - audioOutput->bufferDuration()*/;
-            nextInterval *= 1000;
+    // Bounded, so the frames are not skipped or repeated in bursts
+    const qreal maxCorrection = vsyncTimer.interval() * videoClock.rate() * AV_SYNC_MAX_CORRECTION;
+    const qreal correction = qBound(-maxCorrection, diff, maxCorrection);
 
-            if(nextInterval < 1)
-            {
-                av_frame_free(&frame);
-                continue;
-            }
+    videoClock.adjust(correction);
+    videoCorrection += correction;
+}
 
-            if(interval != nextInterval)
-                this->updateTimer(nextInterval);
-        }
+void VideoPlayerPrivate::updateAudioCompensation()
+{
+    if(!audioClock.isValid() || !videoClock.isValid())
+    {
+        driftTimer.invalidate();
+        return;
+    }
 
-        videoRenderer->updateVideoFrame(frame);
-        break;
+    if(!driftTimer.isValid())
+    {
+        driftTimer.start();
+        videoCorrection = 0;
+        return;
     }
+
+    if(driftTimer.elapsed() < AUDIO_DRIFT_INTERVAL)
+        return;
+
+    // The video clock keeps being pulled one way when the audio device runs faster
+    // or slower than the wall clock, stretch the audio by that rate instead
+    const qreal drift = videoCorrection / playbackRate * 1000 / driftTimer.elapsed();
+    audioCompensation = qBound(-AUDIO_MAX_COMPENSATION, audioCompensation + drift, AUDIO_MAX_COMPENSATION);
+    decoder->setAudioCompensation(audioCompensation);
+
+    videoCorrection = 0;
+    driftTimer.restart();
 }
 
 void VideoPlayerPrivate::updateSubtitleFrame()
 {
     SubtitleFrame *frame = nullptr;
-    if((frame = decoder->takeSubtitleFrame(videoClock.time())))
-        videoRenderer->updateSubtitleFrame(frame);
+    if(!(frame = decoder->takeSubtitleFrame(this->masterClock().time())))
+        return;
+
+    // Not shown yet, there is no texture to take it
+    if(videoTexture)
+        videoTexture->updateSubtitleFrame(frame);
+    else
+        delete frame;
+}
+
+void VideoPlayerPrivate::updatePosition()
+{
+    Q_Q(VideoPlayer);
+
+    if(videoClock.isValid() || audioClock.isValid())
+    {
+        const int newPosition = int(this->masterClock().time());
+        if(newPosition != position)
+        {
+            position = newPosition;
+            emit q->positionChanged(newPosition);
+        }
+    }
+
+    if(!pendingFrame && !decoder->hasFrame() && decoder->isEnd())
+        q->stop();
+}
+
+void VideoPlayerPrivate::updateStats()
+{
+    Q_Q(VideoPlayer);
+
+    const int decodedFrames = decoder->decodedFrames();
+    const qint64 decodeTime = decoder->decodeTime();
+    const int uploadedFrames = videoTexture ? videoTexture->uploadedFrames() : 0;
+    const qint64 uploadTime = videoTexture ? videoTexture->uploadTime() : 0;
+
+    auto msPerFrame = [](qint64 time, int frames) {
+        return frames > 0 ? time / 1e6 / frames : 0.;
+    };
+
+    auto cacheStats = [](const FrameQueue<AVFrame *> &cache) {
+        return QVariantMap {
+            { "frames", cache.count() },
+            { "seconds", cache.duration() },
+            { "bytes", cache.bytes() }
+        };
+    };
+
+    // Positive if the audio is ahead
+    const qreal avOffset = audioClock.isValid() && videoClock.isValid() ?
+                               audioClock.time() - videoClock.time() : 0;
+
+    stats = {
+        { "decodedFrames", decodedFrames },
+        { "presentedFrames", presentedFrames.loadRelaxed() },
+        { "droppedFrames", droppedFrames.loadRelaxed() },
+        { "skippedFrames", decoder->skippedFrames() },
+        { "videoCache", cacheStats(decoder->videoCache()) },
+        { "audioCache", cacheStats(decoder->audioCache()) },
+        { "residentBytes", decoder->residentBytes() },
+        { "avOffset", avOffset },
+        { "frameLateness", frameLateness },
+        { "frameDropLevel", int(frameDropLevel) },
+        { "decodeMsPerFrame", msPerFrame(decodeTime - lastDecodeTime, decodedFrames - lastDecodedFrames) },
+        { "uploadMsPerFrame", msPerFrame(uploadTime - lastUploadTime, uploadedFrames - lastUploadedFrames) },
+        { "threadingMode", QMetaEnum::fromType<PlayerConfig::ThreadingMode>().valueToKey(
+                               q->activeThreadingMode()) },
+        { "conversion", decoder->isVideoConverted() ? "sws" : "native" }
+    };
+
+    const NetworkInput *networkInput = decoder->networkInput();
+    if(networkInput->isOpen())
+        stats.insert("networkBuffer", QVariantMap {
+            { "bytes", networkInput->bufferedBytes() },
+            { "seconds", networkInput->bufferedSeconds() },
+            { "capacity", networkInput->capacity() },
+            { "underruns", networkInput->underruns() },
+            { "cachedBytes", networkInput->cachedBytes() },
+            { "isAtEnd", networkInput->isAtEnd() }
+        });
+
+    lastDecodedFrames = decodedFrames;
+    lastDecodeTime = decodeTime;
+    lastUploadedFrames = uploadedFrames;
+    lastUploadTime = uploadTime;
+
+    emit q->statsChanged();
+}
+
+void VideoPlayerPrivate::resetStats()
+{
+    Q_Q(VideoPlayer);
+
+    // The counters of the texture live as long as it
+    presentedFrames.storeRelaxed(0);
+    lastDecodedFrames = 0;
+    lastDecodeTime = 0;
+    lastUploadedFrames = videoTexture ? videoTexture->uploadedFrames() : 0;
+    lastUploadTime = videoTexture ? videoTexture->uploadTime() : 0;
+
+    stats.clear();
+    emit q->statsChanged();
+}
+
+void VideoPlayerPrivate::setWindow(QQuickWindow *newWindow)
+{
+    Q_Q(VideoPlayer);
+
+    if(window)
+        window->disconnect(q);
+
+    if(!(window = newWindow))
+        return;
+
+    if(window->screen())
+        vsyncTimer.setRefreshRate(window->screen()->refreshRate());
+
+    // Emitted on the render thread, the GUI thread is blocked while synchronizing
+    QObject::connect(window, &QQuickWindow::beforeSynchronizing, q,
+                     [this] { this->presentVideoFrame(); }, Qt::DirectConnection);
+    QObject::connect(window, &QQuickWindow::frameSwapped, q,
+                     [this] { vsyncTimer.swapped(); }, Qt::DirectConnection);
+
+    QObject::connect(window, &QQuickWindow::frameSwapped, q,
+                     [this] { this->onFrameSwapped(); }, Qt::QueuedConnection);
+}
+
+void VideoPlayerPrivate::presentVideoFrame()
+{
+    // Keep the current frame until the pending seek is done
+    if(state != VideoPlayer::Playing || seekTarget >= 0 || isWaitingSeekFrame || !videoTexture)
+        return;
+
+    TRACE_SCOPE("present");
+
+    if(!pendingFrame)
+        pendingFrame = decoder->takeVideoFrame();
+
+    // Free running from the first frame, it is the master clock without audio
+    if(!videoClock.isValid())
+    {
+        if(!pendingFrame)
+            return;
+
+        videoClock.update(FFmpegDecoder::framePts(pendingFrame));
+    }
+
+    // Follow the audio also through a rate change, its cached frames are stretched by the old one
+    videoClock.setRate(audioClock.isValid() ? audioClock.rate() : playbackRate);
+    this->syncVideoClock();
+
+    // A frame is shown on the vblank nearest to its pts, eg. 3:2 for 24 fps on 60 Hz,
+    // the vblanks are timed by the display and the clock by the media
+    const qreal rate = videoClock.rate();
+    const qreal displayTime = videoClock.time() + vsyncTimer.displayDelay() * rate;
+    const qreal deadline = displayTime + vsyncTimer.interval() * rate / 2;
+
+    AVFrame *frame = nullptr;
+    while(pendingFrame && FFmpegDecoder::framePts(pendingFrame) <= deadline)
+    {
+        // Late, superseded by the next one
+        if(frame)
+        {
+            decoder->framePool()->recycle(frame);
+            droppedFrames.ref();
+
+            TRACE_INSTANT("droppedFrame");
+        }
+
+        frame = pendingFrame;
+        pendingFrame = decoder->takeVideoFrame();
+    }
+
+    if(frame)
+    {
+        presentedEnd = FFmpegDecoder::framePts(frame) + FFmpegDecoder::frameDuration(frame);
+        videoTexture->updateVideoFrame(frame);
+        presentedFrames.ref();
+
+        // The framebuffer object is not rendered again without a new frame
+        if(videoRenderer)
+            videoRenderer->scheduleRender();
+    }
+
+    // Behind if the frame for the display time has not been decoded yet
+    const qreal lateness = pendingFrame || presentedEnd < 0 || decoder->isEnd() ?
+                               0 : qMax(displayTime - presentedEnd, 0.);
+    frameLateness += (lateness - frameLateness) / FRAME_LATENESS_SMOOTHING;
+}
+
+void VideoPlayerPrivate::updateFrameDropLevel()
+{
+    // Fast forwarding with more frames than vblanks, the non-reference ones would be dropped anyway
+    const qreal refreshRate = window && window->screen() ? window->screen()->refreshRate() : 60;
+    const int minLevel = playbackRate > 1 && playbackRate * decoder->fps() > refreshRate ?
+                             FFmpegDecoder::DropNonReference : FFmpegDecoder::NoFrameDrop;
+
+    int level = frameDropLevel;
+    if(level < minLevel)
+        level = minLevel;
+    // Give the decoder time to show the effect, the frames in the cache are decoded already
+    else if(frameDropTimer.isValid() && frameDropTimer.elapsed() < FRAME_DROP_HOLD)
+        return;
+    else if(frameLateness > FRAME_DROP_RAISE_LATENESS && level < FFmpegDecoder::DropNonKey)
+        ++level;
+    else if(frameLateness < FRAME_DROP_LOWER_LATENESS && level > minLevel)
+        --level;
+    else
+        return;
+
+    frameDropLevel = static_cast<FFmpegDecoder::FrameDropLevel>(level);
+    decoder->setFrameDropLevel(frameDropLevel);
+
+    frameDropTimer.start();
+}
+
+void VideoPlayerPrivate::onFrameSwapped()
+{
+    Q_Q(VideoPlayer);
+
+    if(state != VideoPlayer::Playing || qIsNaN(decoder->fps()))
+        return;
+
+    swapTimer.start();
+
+    if(isWaitingSeekFrame)
+        this->updateSeekFrame();
+    else if(seekTarget < 0)
+    {
+        this->updateSubtitleFrame();
+        this->updatePosition();
+        this->updateAudioCompensation();
+        this->updateFrameDropLevel();
+    }
+
+    // Synchronize on every vblank while playing, the render loop is throttled by the vsync
+    if(state != VideoPlayer::Playing)
+        return;
+
+    if(renderMode == VideoPlayer::FramebufferRendering && window)
+        window->update();
+    else
+        q->update();
+}
+
+void VideoPlayerPrivate::presentWithoutWindow()
+{
+    if(!pendingFrame)
+        pendingFrame = decoder->takeVideoFrame();
+
+    if(!videoClock.isValid())
+    {
+        if(!pendingFrame)
+            return;
+
+        videoClock.update(FFmpegDecoder::framePts(pendingFrame));
+    }
+
+    videoClock.setRate(audioClock.isValid() ? audioClock.rate() : playbackRate);
+    this->syncVideoClock();
+
+    // Not shown at all, they are not counted as dropped
+    const qreal time = videoClock.time();
+    while(pendingFrame && FFmpegDecoder::framePts(pendingFrame) <= time)
+    {
+        decoder->framePool()->recycle(pendingFrame);
+        pendingFrame = decoder->takeVideoFrame();
+    }
+
+    this->updateSubtitleFrame();
+}
+
+void VideoPlayerPrivate::clearPendingFrame()
+{
+    if(pendingFrame)
+    {
+        decoder->framePool()->recycle(pendingFrame);
+        pendingFrame = nullptr;
+    }
+
+    // The presentation starts over
+    presentedEnd = -1;
+    frameLateness = 0;
+}
+
+void VideoPlayerPrivate::setStatus(VideoPlayer::Status newStatus)
+{
+    Q_Q(VideoPlayer);
+
+    if(status == newStatus)
+        return;
+
+    status = newStatus;
+    emit q->statusChanged(newStatus);
+}
+
+void VideoPlayerPrivate::onDecoderStateChanged(FFmpegDecoder::State decoderState)
+{
+    Q_Q(VideoPlayer);
+
+    // Stopped while loading, or not the end of the load
+    if(status != VideoPlayer::Loading || decoderState == FFmpegDecoder::Loading)
+        return;
+
+    if(decoderState == FFmpegDecoder::Closed)
+    {
+        hasTracks = false;
+        this->setStatus(VideoPlayer::Unloaded);
+
+        state = VideoPlayer::Stopped;
+        emit q->playbackStateChanged(VideoPlayer::Stopped);
+
+        emit q->errorOccurred(q->errorString());
+        return;
+    }
+
+    const auto fps = decoder->fps();
+    interval = qIsNaN(fps) ? 1000.0 : 1000 / fps;
+
+    // Kept running while paused, the caches are still filled
+    this->resetStats();
+    if(config->statsInterval() > 0)
+        statsTimerId = q->startTimer(config->statsInterval());
+
+    this->setStatus(VideoPlayer::Ready);
+
+    // Otherwise paused while loading
+    if(state == VideoPlayer::Playing)
+        this->startPresentation();
+}
+
+void VideoPlayerPrivate::onTracksFound()
+{
+    Q_Q(VideoPlayer);
+
+    if(status != VideoPlayer::Loading)
+        return;
+
+    hasTracks = true;
+    emit q->loaded();
+}
+
+void VideoPlayerPrivate::startPresentation()
+{
+    Q_Q(VideoPlayer);
+
+    // With video only the fallback while the window does not render, see also VideoPlayer::timerEvent()
+    timerId = q->startTimer(interval, Qt::PreciseTimer);
+
+    if(!qIsNaN(decoder->fps()))
+    {
+        swapTimer.start();
+        q->update();     // Kick off the presentation, see also VideoPlayerPrivate::onFrameSwapped()
+    }
+
+    audioOutput->play();
+}
+
+void VideoPlayerPrivate::onSeeked(int position, int serial)
+{
+    Q_Q(VideoPlayer);
+
+    // Superseded by a later request, maybe to the same position
+    if(seekTarget < 0 || serial != seekSerial)
+        return;
+
+    seekTarget = -1;
+
+    audioOutput->reset();
+
+    decoder->framePool()->recycle(audioFrame);
+    audioFrame = nullptr;
+    audioFramePos = 0;
+
+    this->clearPendingFrame();
+
+    videoClock.invalidate();
+    audioClock.invalidate();
+    if(videoTexture)
+        videoTexture->updateSubtitleFrame(nullptr);
+
+    if(qIsNaN(decoder->fps()))
+    {
+        emit q->seekCompleted(position);
+        return;
+    }
+
+    isWaitingSeekFrame = true;
+
+    // The playback timer is not running
+    if(state == VideoPlayer::Paused && seekTimerId < 0)
+        seekTimerId = q->startTimer(interval, Qt::PreciseTimer);
+}
+
+void VideoPlayerPrivate::updateSeekFrame()
+{
+    Q_Q(VideoPlayer);
+
+    AVFrame *frame = decoder->takeVideoFrame();
+    if(!frame)
+        return;
+
+    const qreal pts = FFmpegDecoder::framePts(frame);
+    if(!qFuzzyCompare(pts, -1))
+        videoClock.update(pts);
+
+    // Not shown yet, the clock is set by the frame anyway
+    if(videoTexture)
+    {
+        videoTexture->updateVideoFrame(frame);
+        presentedFrames.ref();
+    }
+    else
+        decoder->framePool()->recycle(frame);
+    q->update();
+
+    isWaitingSeekFrame = false;
+
+    if(seekTimerId >= 0)
+    {
+        q->killTimer(seekTimerId);
+        seekTimerId = -1;
+    }
+
+    emit q->seekCompleted(position);
 }
@@ -8,25 +8,51 @@
 #define VIDEOPLAYERPRIVATE_H
 
 #include "videoplayer.h"
+#include "ffmpegdecoder.h"
 
+#include <QPointer>
+#include <QVariant>
+#include <QQuickWindow>
 #include <QElapsedTimer>
 
+#include <cmath>
+
 struct AVFrame;
 
 class AudioOutput;
-class FFmpegDecoder;
+class PlayerConfig;
+class VideoTexture;
 class VideoRenderer;
 
 class Clock
 {
     qreal m_time = 0;
+    qreal m_rate = 1;
+    bool m_isPaused = false;
     QElapsedTimer m_updateClock;
+
+    qreal elapsed() const { return m_isPaused ? 0 : m_rate * m_updateClock.elapsed() / 1000; }
 public:
     explicit Clock() = default;
 
-    qreal time() const { return m_time + qreal(m_updateClock.elapsed()) / 1000; }
+    qreal time() const { return m_time + this->elapsed(); }
     bool isValid() const { return m_updateClock.isValid(); }
 
+    /**
+     * @brief Seconds of the media per second, the time goes on from where it is
+     */
+    qreal rate() const { return m_rate; }
+    void setRate(qreal rate)
+    {
+        if(m_updateClock.isValid())
+        {
+            m_time = this->time();
+            m_updateClock.start();
+        }
+
+        m_rate = rate;
+    }
+
     void update(qreal time)
     {
         m_time = time;
@@ -36,11 +62,69 @@ public:
     void pause()
     {
         if(m_updateClock.isValid())
-            m_time += qreal(m_updateClock.elapsed()) / 1000;
+            m_time = this->time();
+
+        m_isPaused = true;
+    }
+    /**
+     * @brief An invalidated clock stays invalid until the next update
+     */
+    void resume()
+    {
+        m_isPaused = false;
+
+        if(m_updateClock.isValid())
+            m_updateClock.start();
     }
-    void resume() { m_updateClock.start(); }
 
-    void invalidate() { m_updateClock.invalidate(); }
+    void adjust(qreal delta) { m_time += delta; }
+
+    void invalidate()
+    {
+        m_isPaused = false;
+        m_updateClock.invalidate();
+    }
+};
+
+/**
+ * @brief Predict the vblanks of the window from its buffer swaps
+ * @note Used on the render thread only
+ */
+class VsyncTimer
+{
+    QElapsedTimer m_timer;
+    qint64 m_lastSwap = -1;         // in nanoseconds
+    qreal m_interval = 1. / 60;     // in seconds
+public:
+    explicit VsyncTimer() { m_timer.start(); }
+
+    qreal interval() const { return m_interval; }
+    void setRefreshRate(qreal rate) { if(rate > 0) m_interval = 1 / rate; }
+
+    void swapped()
+    {
+        const qint64 now = m_timer.nsecsElapsed();
+
+        // Ignore the stalls, eg. the window was hidden
+        const qreal delta = qreal(now - m_lastSwap) / 1000000000;
+        if(m_lastSwap >= 0 && delta > m_interval / 2 && delta < m_interval * 1.5)
+            m_interval += (delta - m_interval) / 16;
+
+        m_lastSwap = now;
+    }
+
+    /**
+     * @return seconds until the frame synchronized now is displayed,
+     *         that is the vblank after the next swap
+     */
+    qreal displayDelay() const
+    {
+        if(m_lastSwap < 0)
+            return m_interval;
+
+        const qreal sinceSwap = qreal(m_timer.nsecsElapsed() - m_lastSwap) / 1000000000;
+        return m_interval - std::fmod(sinceSwap, m_interval);
+    }
 };
 
 class VideoPlayerPrivate
@@ -48,33 +132,139 @@ class VideoPlayerPrivate
 public:
     VideoPlayerPrivate(VideoPlayer *parent) : q_ptr(parent) {}
 
+    PlayerConfig *config = nullptr;
     FFmpegDecoder *decoder = nullptr;
 
     AudioOutput *audioOutput = nullptr;
-    VideoRenderer *videoRenderer = nullptr;
+    VideoTexture *videoTexture = nullptr;     // Of the VideoRenderer or the VideoNode
+    VideoRenderer *videoRenderer = nullptr;   // Of the FramebufferRendering mode
 
     VideoPlayer::State state = VideoPlayer::Stopped;
+    VideoPlayer::Status status = VideoPlayer::Unloaded;
+    bool hasTracks = false;             // The decoder has found the tracks, see also FFmpegDecoder::tracksFound()
+    VideoPlayer::RenderMode renderMode = VideoPlayer::FramebufferRendering;
 
     int position = 0;
 
     int interval = 0;
-    int timerId = -1;
+    int timerId = -1;                   // Drives the playback without video or without the window rendering
+
+    QPointer<QQuickWindow> window;
+    VsyncTimer vsyncTimer;
+    QElapsedTimer swapTimer;            // Since the last frame swapped, on the GUI thread
+    AVFrame *pendingFrame = nullptr;    // Taken from the cache but too early to be shown
+    qreal presentedEnd = -1;            // End time of the frame handed over last
+
+    // Adaptive frame drop, see also VideoPlayerPrivate::updateFrameDropLevel()
+    qreal frameLateness = 0;            // Smoothed, in seconds
+    FFmpegDecoder::FrameDropLevel frameDropLevel = FFmpegDecoder::NoFrameDrop;
+    QElapsedTimer frameDropTimer;       // Since the level was changed
+    QAtomicInt droppedFrames;           // Decoded but too late to be shown
+
+    // See also VideoPlayer::stats
+    QVariantMap stats;
+    int statsTimerId = -1;
+    QAtomicInt presentedFrames;         // Handed over to the texture
+    int lastDecodedFrames = 0;          // The counters at the last update, for the averages
+    qint64 lastDecodeTime = 0;
+    int lastUploadedFrames = 0;
+    qint64 lastUploadTime = 0;
+
+    int seekTarget = -1;                // The latest requested seek position, -1 means no seek is pending
+    int seekSerial = 0;                 // Of the latest request, see also FFmpegDecoder::requestSeek()
+    bool isWaitingSeekFrame = false;    // The first frame after the seek has not been shown
+    int seekTimerId = -1;               // Polls the first frame while paused
 
     AVFrame *audioFrame = nullptr;
     qint64 audioFramePos = 0;
 
+    qreal audioLatency = 0;             // See also PlayerConfig::audioLatency
+    qreal playbackRate = 1;
+    qreal videoCorrection = 0;          // Applied to the video clock since driftTimer started
+    qreal audioCompensation = 0;        // See also FFmpegDecoder::setAudioCompensation()
+    QElapsedTimer driftTimer;
+
     void restartAudioOutput();
 
     Clock videoClock;
     Clock audioClock;
 
+    /**
+     * @return the audio clock if valid, otherwise the video clock
+     */
+    const Clock &masterClock() const { return audioClock.isValid() ? audioClock : videoClock; }
+
     qint64 updateAudioData(char *data, qint64 maxlen);
-    void updateVideoFrame();
+
+    /**
+     * @brief Update the audio clock from the time being heard now
+     */
+    void updateAudioClock(qreal time);
+
+    /**
+     * @brief Pull the video clock towards the audio clock, called on presenting
+     */
+    void syncVideoClock();
+
+    /**
+     * @brief Turn the persistent correction of the video clock into the resampler compensation
+     */
+    void updateAudioCompensation();
+
     void updateSubtitleFrame();
+    void updatePosition();
 
-private:
-    inline void updateTimer(int newInterval);
+    /**
+     * @brief Sample the counters of the pipeline into VideoPlayer::stats,
+     *        the per frame times are averaged since the last update
+     */
+    void updateStats();
+    void resetStats();
+
+    void setWindow(QQuickWindow *newWindow);
+
+    /**
+     * @brief Hand over the frame matching the display time of the next vblank,
+     *        called on the render thread before synchronizing
+     */
+    void presentVideoFrame();
+
+    /**
+     * @brief Raise the frame drop level of the decoder while the presentation is behind,
+     *        lower it once caught up
+     */
+    void updateFrameDropLevel();
+    void onFrameSwapped();
+
+    /**
+     * @return the window has not swapped a frame for RENDER_STALL_FRAMES while playing the video
+     */
+    bool isRenderStalled() const { return !swapTimer.isValid() || swapTimer.elapsed() > interval * RENDER_STALL_FRAMES; }
 
+    /**
+     * @brief Drop the frames up to the clock and update the subtitle while the window does not render,
+     *        so the decoder keeps going and the clocks keep the sync
+     */
+    void presentWithoutWindow();
+    void clearPendingFrame();
+
+    void setStatus(VideoPlayer::Status newStatus);
+
+    /**
+     * @brief Finish the load started by VideoPlayer::play()
+     */
+    void onDecoderStateChanged(FFmpegDecoder::State decoderState);
+    void onTracksFound();
+
+    /**
+     * @brief Drive the presentation and the audio output, called on playing once ready
+     */
+    void startPresentation();
+
+    void onSeeked(int position, int serial);
+    void updateSeekFrame();
+
+private:
     VideoPlayer *const q_ptr;
     Q_DECLARE_PUBLIC(VideoPlayer)
 };
@@ -0,0 +1,577 @@
+/**
+ * @brief Video Texture
+ * @anchor Ho 229
+ * @date 2023/5/19
+ */
+
+#include "tracer.h"
+#include "videotexture.h"
+
+#include <QElapsedTimer>
+#include <QOpenGLShaderProgram>
+#include <QOpenGLPixelTransferOptions>
+
+/**
+ * @ref https://vocal.com/video/rgb-and-yuv-color-space-conversion/
+ * @ref https://en.wikipedia.org/wiki/YCbC
+ */
+static const float colorinverseMatrices[][3 * 3] = {
+    // BT.601
+    {
+        1, 0,        1.13983,
+        1, -0.39465, -0.5806,
+        1, 2.03211,  0
+    },
+    // BT.709
+    {
+        1, 0,       1.5748,
+        1, -0.1873, -0.4681,
+        1, 1.8556,  0
+    },
+    // BT.2020
+    {
+        1, 0,        1.4746,
+        1, -0.16455, -0.5714,
+        1, 1.8814,   0
+    }
+};
+
+enum Flag
+{
+    VideoFrameUpdate = 1,
+    SubtitleFrameUpdate = 2,
+};
+
+// Same as pixelLayout in fragment.fsh
+enum PixelLayout
+{
+    Planar = 0,         // Y, U, V
+    SemiPlanar = 1,     // Y, UV
+    SemiPlanarVU = 2,   // Y, VU
+    Packed = 3,         // RGB
+};
+
+struct PlaneFormat
+{
+    QOpenGLTexture::TextureFormat textureFormat;
+    QOpenGLTexture::PixelFormat pixelFormat;
+    QOpenGLTexture::PixelType pixelType;
+    int bytesPerPixel;
+};
+
+struct VideoTextureFormat
+{
+    AVPixelFormat format;
+    PixelLayout layout;
+    float sampleScale;          // Normalize the samples of less than 16 bits in 16-bit textures
+    int planeCount;
+    PlaneFormat planes[3];
+};
+
+static constexpr PlaneFormat R8 = { QOpenGLTexture::R8_UNorm, QOpenGLTexture::Red, QOpenGLTexture::UInt8, 1 };
+static constexpr PlaneFormat RG8 = { QOpenGLTexture::RG8_UNorm, QOpenGLTexture::RG, QOpenGLTexture::UInt8, 2 };
+static constexpr PlaneFormat R16 = { QOpenGLTexture::R16_UNorm, QOpenGLTexture::Red, QOpenGLTexture::UInt16, 2 };
+static constexpr PlaneFormat RG16 = { QOpenGLTexture::RG16_UNorm, QOpenGLTexture::RG, QOpenGLTexture::UInt16, 4 };
+static constexpr PlaneFormat RGB8 = { QOpenGLTexture::RGB8_UNorm, QOpenGLTexture::RGB, QOpenGLTexture::UInt8, 3 };
+static constexpr PlaneFormat BGR8 = { QOpenGLTexture::RGB8_UNorm, QOpenGLTexture::BGR, QOpenGLTexture::UInt8, 3 };
+static constexpr PlaneFormat RGBA8 = { QOpenGLTexture::RGBA8_UNorm, QOpenGLTexture::RGBA, QOpenGLTexture::UInt8, 4 };
+static constexpr PlaneFormat BGRA8 = { QOpenGLTexture::RGBA8_UNorm, QOpenGLTexture::BGRA, QOpenGLTexture::UInt8, 4 };
+
+static constexpr float Scale10Bit = 65535.f / 1023;
+static constexpr float Scale12Bit = 65535.f / 4095;
+
+/**
+ * @note Keep it in sync with FFmpegDecoder::setActiveVideoTrack(),
+ *       the other formats are converted to AV_PIX_FMT_YUV420P
+ */
+static const VideoTextureFormat videoTextureFormats[] = {
+    { AV_PIX_FMT_YUV420P,       Planar,         1,          3, { R8, R8, R8 } },
+    { AV_PIX_FMT_YUVJ420P,      Planar,         1,          3, { R8, R8, R8 } },
+    { AV_PIX_FMT_YUV422P,       Planar,         1,          3, { R8, R8, R8 } },
+    { AV_PIX_FMT_YUVJ422P,      Planar,         1,          3, { R8, R8, R8 } },
+    { AV_PIX_FMT_YUV444P,       Planar,         1,          3, { R8, R8, R8 } },
+    { AV_PIX_FMT_YUVJ444P,      Planar,         1,          3, { R8, R8, R8 } },
+    { AV_PIX_FMT_YUV420P10LE,   Planar,         Scale10Bit, 3, { R16, R16, R16 } },
+    { AV_PIX_FMT_YUV422P10LE,   Planar,         Scale10Bit, 3, { R16, R16, R16 } },
+    { AV_PIX_FMT_YUV444P10LE,   Planar,         Scale10Bit, 3, { R16, R16, R16 } },
+    { AV_PIX_FMT_YUV420P12LE,   Planar,         Scale12Bit, 3, { R16, R16, R16 } },
+    { AV_PIX_FMT_YUV422P12LE,   Planar,         Scale12Bit, 3, { R16, R16, R16 } },
+    { AV_PIX_FMT_YUV444P12LE,   Planar,         Scale12Bit, 3, { R16, R16, R16 } },
+    { AV_PIX_FMT_NV12,          SemiPlanar,     1,          2, { R8, RG8 } },
+    { AV_PIX_FMT_NV21,          SemiPlanarVU,   1,          2, { R8, RG8 } },
+    { AV_PIX_FMT_P010LE,        SemiPlanar,     1,          2, { R16, RG16 } },     // MSB aligned
+    { AV_PIX_FMT_RGB24,         Packed,         1,          1, { RGB8 } },
+    { AV_PIX_FMT_BGR24,         Packed,         1,          1, { BGR8 } },
+    { AV_PIX_FMT_RGBA,          Packed,         1,          1, { RGBA8 } },
+    { AV_PIX_FMT_RGB0,          Packed,         1,          1, { RGBA8 } },
+    { AV_PIX_FMT_BGRA,          Packed,         1,          1, { BGRA8 } },
+    { AV_PIX_FMT_BGR0,          Packed,         1,          1, { BGRA8 } },
+};
+
+static const VideoTextureFormat *videoTextureFormat(int format)
+{
+    for(const VideoTextureFormat &textureFormat : videoTextureFormats)
+    {
+        if(textureFormat.format == format)
+            return &textureFormat;
+    }
+
+    return nullptr;
+}
+
+/**
+ * @brief Unpack rows of linesize bytes, the linesize of 3-byte pixels
+ *        is not a multiple of the pixel size but FFmpeg aligns it to 8 at least
+ */
+static void unpackRows(int linesize, int bytesPerPixel, int &rowLength, int &alignment)
+{
+    rowLength = linesize / bytesPerPixel;
+    alignment = linesize % 8 ? 1 : 8;
+}
+
+// Offset alignment of the planes in the pixel buffer
+#define PIXEL_BUFFER_ALIGN 64
+
+// Maximum time to wait for the GPU to release a pixel buffer, in nanoseconds
+#define PIXEL_BUFFER_TIMEOUT 100000000
+
+static QMatrix3x3 colorInverseMatrix(AVColorSpace space, AVColorRange range);
+static void adjustColorRange(QMatrix3x3 &inverse, AVColorRange range);
+
+VideoTexture::VideoTexture()
+{
+    this->initializeOpenGLFunctions();
+}
+
+VideoTexture::~VideoTexture()
+{
+    if(m_textureAlloced)
+        this->destoryTexture();
+
+    if(m_frame)
+        this->recycleFrame(m_frame);
+
+    delete m_subtitle;
+
+    this->destroyPixelBuffers();
+}
+
+void VideoTexture::updateVideoFrame(AVFrame *frame)
+{
+    // The previous frame has not been uploaded yet
+    if(m_frame && m_frame != frame)
+        this->recycleFrame(m_frame);
+
+    m_frame = frame;
+    m_flags |= VideoFrameUpdate;
+}
+
+void VideoTexture::updateSubtitleFrame(SubtitleFrame *frame)
+{
+    m_subtitle = frame;
+    m_flags |= SubtitleFrameUpdate;
+}
+
+bool VideoTexture::synchronize()
+{
+    TRACE_SCOPE("synchronize");
+
+    bool isAllocated = false;
+
+    if(m_flags & VideoFrameUpdate)
+    {
+        if(m_frame)
+        {
+            // Allocate texture when the first frame is encountered
+            if(!m_textureAlloced)
+            {
+                m_videoSize = {m_frame->width, m_frame->height};
+                this->setupTexture();
+                isAllocated = m_textureAlloced;
+            }
+
+            // The previous frame has not been rendered yet
+            if(m_uploadFrame)
+                this->recycleFrame(m_uploadFrame);
+
+            m_uploadFrame = m_frame;
+            m_frame = nullptr;
+        }
+        else if(m_textureAlloced)
+            this->destoryTexture();
+    }
+
+    if(m_flags & SubtitleFrameUpdate && m_textureAlloced)
+        this->updateSubtitleTextureData();
+
+    m_flags = 0;
+
+    return isAllocated;
+}
+
+void VideoTexture::upload()
+{
+    TRACE_SCOPE("upload");
+
+    if(!m_textureAlloced || !m_uploadFrame)
+        return;
+
+    QElapsedTimer timer;
+    timer.start();
+    if(!this->updateVideoTextureData())
+        return;
+
+    m_uploadTime.fetchAndAddRelaxed(timer.nsecsElapsed());
+    m_uploadedFrames.ref();
+}
+
+void VideoTexture::bind()
+{
+    for(int i = 0; i < 4; ++i)
+    {
+        if(m_texture[i])
+            m_texture[i]->bind(uint(i), QOpenGLTexture::ResetTextureUnit);
+    }
+}
+
+void VideoTexture::release()
+{
+    for(int i = 3; i > -1; --i)
+    {
+        if(m_texture[i])
+            m_texture[i]->release(uint(i), QOpenGLTexture::ResetTextureUnit);
+    }
+}
+
+void VideoTexture::setUniforms(QOpenGLShaderProgram *program) const
+{
+    // Set texture unit
+    for(int i = 0; i < 4; ++i)
+        program->setUniformValue(i, i);
+
+    if(!m_textureFormat)
+        return;
+
+    // colorConversion
+    program->setUniformValue(4, m_colorConversion);
+
+    // sampleScale
+    program->setUniformValue(5, m_textureFormat->sampleScale);
+
+    // pixelLayout
+    program->setUniformValue(6, int(m_textureFormat->layout));
+
+    // colorOffset
+    program->setUniformValue(7, m_colorOffset);
+}
+
+bool VideoTexture::updateVideoTextureData()
+{
+    const int planeCount = m_textureFormat->planeCount;
+
+    GLsizeiptr offsets[3], sizes[3], total = 0;
+    for(int i = 0; i < planeCount; ++i)
+    {
+        offsets[i] = total;
+        sizes[i] = GLsizeiptr(m_uploadFrame->linesize[i]) * m_texture[i]->height();
+        total += FFALIGN(sizes[i], PIXEL_BUFFER_ALIGN);
+    }
+
+    // Not retried every frame once the mapping has failed
+    if(!m_isPixelBufferFailed && total > m_pixelBufferSize)
+        m_isPixelBufferFailed = !this->allocatePixelBuffers(total);
+
+    if(m_isPixelBufferFailed)
+    {
+        // Fallback to the synchronous upload
+        QOpenGLPixelTransferOptions options;
+        options.setImageHeight(m_uploadFrame->height);
+
+        for(int i = 0; i < planeCount; ++i)
+        {
+            const PlaneFormat &plane = m_textureFormat->planes[i];
+
+            int rowLength, alignment;
+            unpackRows(m_uploadFrame->linesize[i], plane.bytesPerPixel, rowLength, alignment);
+
+            options.setRowLength(rowLength);
+            options.setAlignment(alignment);
+            m_texture[i]->setData(plane.pixelFormat, plane.pixelType,
+                                  reinterpret_cast<const void *>(m_uploadFrame->data[i]), &options);
+        }
+
+        this->recycleFrame(m_uploadFrame);
+        return true;
+    }
+
+    PixelBuffer &buffer = m_pixelBuffers[m_pixelBufferIndex];
+    m_pixelBufferIndex = (m_pixelBufferIndex + 1) % PixelBufferCount;
+
+    // Normally signaled long ago, the ring is deeper than the frames in flight
+    if(buffer.fence)
+    {
+        // Still read by the GPU, the previous frame is kept rather than torn
+        if(glClientWaitSync(buffer.fence, GL_SYNC_FLUSH_COMMANDS_BIT, PIXEL_BUFFER_TIMEOUT) == GL_TIMEOUT_EXPIRED)
+        {
+            this->recycleFrame(m_uploadFrame);
+            return false;
+        }
+
+        glDeleteSync(buffer.fence);
+        buffer.fence = nullptr;
+    }
+
+    int linesizes[3];
+    for(int i = 0; i < planeCount; ++i)
+    {
+        linesizes[i] = m_uploadFrame->linesize[i];
+        memcpy(static_cast<uchar *>(buffer.data) + offsets[i], m_uploadFrame->data[i], size_t(sizes[i]));
+    }
+
+    this->recycleFrame(m_uploadFrame);
+
+    // The texture upload is sourced from the buffer, so it returns immediately
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer.id);
+
+    for(int i = 0; i < planeCount; ++i)
+    {
+        const PlaneFormat &plane = m_textureFormat->planes[i];
+
+        int rowLength, alignment;
+        unpackRows(linesizes[i], plane.bytesPerPixel, rowLength, alignment);
+
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, rowLength);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, alignment);
+
+        m_texture[i]->bind();
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, m_texture[i]->width(), m_texture[i]->height(),
+                        plane.pixelFormat, plane.pixelType, reinterpret_cast<const void *>(offsets[i]));
+        m_texture[i]->release();
+    }
+
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    buffer.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+    return true;
+}
+
+void VideoTexture::recycleFrame(AVFrame *&frame)
+{
+    if(m_framePool)
+    {
+        m_framePool->recycle(frame);
+        frame = nullptr;
+    }
+    else
+        av_frame_free(&frame);
+}
+
+bool VideoTexture::allocatePixelBuffers(GLsizeiptr size)
+{
+    this->destroyPixelBuffers();
+
+    const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+    for(PixelBuffer &buffer : m_pixelBuffers)
+    {
+        glGenBuffers(1, &buffer.id);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer.id);
+        glBufferStorage(GL_PIXEL_UNPACK_BUFFER, size, nullptr, flags);
+
+        if(!(buffer.data = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, flags)))
+        {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            this->destroyPixelBuffers();
+
+            FUNC_ERROR << ": Map pixel buffer failed.";
+            return false;
+        }
+    }
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    m_pixelBufferSize = size;
+    return true;
+}
+
+void VideoTexture::destroyPixelBuffers()
+{
+    for(PixelBuffer &buffer : m_pixelBuffers)
+    {
+        if(buffer.fence)
+            glDeleteSync(buffer.fence);
+
+        if(buffer.id)
+        {
+            if(buffer.data)
+            {
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer.id);
+                glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            }
+
+            glDeleteBuffers(1, &buffer.id);
+        }
+
+        buffer = PixelBuffer();
+    }
+
+    m_pixelBufferSize = 0;
+    m_pixelBufferIndex = 0;
+}
+
+void VideoTexture::updateSubtitleTextureData()
+{
+    const void *data = m_dummySubtitle.data();
+    if(m_subtitle)
+    {
+        if(m_texture[3]->width() != m_subtitle->image.width() || m_texture[3]->height() != m_subtitle->image.height())
+            this->updateSubtitleTexture(m_subtitle->image.size());
+
+        data = m_subtitle->image.constBits();
+    }
+
+    m_texture[3]->setData(QOpenGLTexture::RGBA, QOpenGLTexture::UInt8, data);
+
+    delete m_subtitle;
+    m_subtitle = nullptr;
+}
+
+void VideoTexture::setupTexture()
+{
+    if(!(m_textureFormat = videoTextureFormat(m_frame->format)))
+    {
+        qCritical() << "Unsupport pixel format:" << m_frame->format;
+        return;
+    }
+
+    // The chroma planes are subsampled, the packed plane is always full size
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(AVPixelFormat(m_frame->format));
+    const QSize chromaSize(AV_CEIL_RSHIFT(m_videoSize.width(), desc->log2_chroma_w),
+                           AV_CEIL_RSHIFT(m_videoSize.height(), desc->log2_chroma_h));
+
+    const QSize sizes[3] = { m_videoSize, chromaSize, chromaSize };
+    this->allocateTexture(sizes);
+
+    // The packed RGB frames are sampled as they are, see also fragment.fsh
+    if(m_textureFormat->layout == Packed)
+    {
+        m_colorConversion.setToIdentity();
+        m_colorOffset = QVector3D();
+        return;
+    }
+
+    m_colorConversion = colorInverseMatrix(m_frame->colorspace, m_frame->color_range);
+
+    // Full range (YUVJ) has no footroom on luma
+    m_colorOffset = QVector3D(m_frame->color_range == AVCOL_RANGE_JPEG ? 0.f : 16.f / 255,
+                              128.f / 255, 128.f / 255);
+}
+
+void VideoTexture::allocateTexture(const QSize sizes[3])
+{
+    for(int i = 0; i < m_textureFormat->planeCount; ++i)
+    {
+        const PlaneFormat &plane = m_textureFormat->planes[i];
+
+        m_texture[i] = new QOpenGLTexture(QOpenGLTexture::Target2D);
+        m_texture[i]->setFormat(plane.textureFormat);
+        m_texture[i]->setMinMagFilters(QOpenGLTexture::Linear, QOpenGLTexture::Linear);
+        m_texture[i]->setWrapMode(QOpenGLTexture::ClampToEdge);
+        m_texture[i]->setSize(sizes[i].width(), sizes[i].height());
+        m_texture[i]->allocateStorage(plane.pixelFormat, plane.pixelType);
+    }
+
+    m_texture[3] = new QOpenGLTexture(QOpenGLTexture::Target2D);
+
+    // Temporary initialization, because the subtitle size is not known until the subtitle frame is decoded
+    this->updateSubtitleTexture(sizes[0]);      // sizes[0](Y channel) must be original size
+
+    m_textureAlloced = true;
+}
+
+void VideoTexture::updateSubtitleTexture(const QSize &size)
+{
+    if(m_texture[3]->isCreated())
+        m_texture[3]->destroy();
+
+    m_texture[3]->setFormat(QOpenGLTexture::RGBA8_UNorm);
+    m_texture[3]->setMinMagFilters(QOpenGLTexture::Linear, QOpenGLTexture::Linear);
+    m_texture[3]->setWrapMode(QOpenGLTexture::ClampToEdge);
+    m_texture[3]->setSize(size.width(), size.height());
+    m_texture[3]->allocateStorage(QOpenGLTexture::RGBA, QOpenGLTexture::UInt8);
+
+    m_dummySubtitle.reset(new GLubyte[size.width() * size.height() * 4]());
+}
+
+void VideoTexture::destoryTexture()
+{
+    for(size_t i = 0; i < 4; ++i)
+    {
+        delete m_texture[i];
+        m_texture[i] = nullptr;
+    }
+
+    if(m_uploadFrame)
+        this->recycleFrame(m_uploadFrame);
+
+    m_textureAlloced = false;
+}
+
+static void adjustColorRange(QMatrix3x3 &inverse, AVColorRange range)
+{
+    auto mulPerLine = [&](const float vec[3]) {
+        for(size_t i = 0; i < 3; ++i)
+        {
+            for(size_t j = 0; j < 3; ++j)
+                inverse(i, j) *= vec[i];
+        }
+    };
+
+    static const float jpeg[] = {255. / (255 - 0), 255. / (255 - 1), 255. / (255 - 1)};
+    static const float mpeg[] = {255. / (235 - 16), 255. / (240 - 16), 255. / (240 - 16)};
+
+    switch(range)
+    {
+    case AVCOL_RANGE_UNSPECIFIED:
+    case AVCOL_RANGE_MPEG:
+        mulPerLine(mpeg);
+        break;
+    case AVCOL_RANGE_JPEG:
+        mulPerLine(jpeg);
+        break;
+    default:
+        break;
+    }
+}
+
+static QMatrix3x3 colorInverseMatrix(AVColorSpace space, AVColorRange range)
+{
+    QMatrix3x3 ret;
+
+    switch(space)
+    {
+    case AVCOL_SPC_BT470BG:
+    case AVCOL_SPC_SMPTE170M:
+        ret = QMatrix3x3(colorinverseMatrices[0]);
+        break;
+    case AVCOL_SPC_BT709:
+        ret = QMatrix3x3(colorinverseMatrices[1]);
+        break;
+    case AVCOL_SPC_UNSPECIFIED:
+    case AVCOL_SPC_BT2020_NCL:
+    case AVCOL_SPC_BT2020_CL:
+        ret = QMatrix3x3(colorinverseMatrices[2]);
+        break;
+    default:
+        FUNC_ERROR << "Unsupported color space: " << space << ", fallback to BT.2020";
+        ret = QMatrix3x3(colorinverseMatrices[2]);
+        break;
+    }
+
+    adjustColorRange(ret, range);
+    return ret;
+}
@@ -0,0 +1,136 @@
+/**
+ * @brief Video Texture
+ * @anchor Ho 229
+ * @date 2023/5/19
+ */
+
+#ifndef VIDEOTEXTURE_H
+#define VIDEOTEXTURE_H
+
+#include "ffmpegdecoder.h"
+
+#include <QVector3D>
+#include <QAtomicInt>
+#include <QGenericMatrix>
+#include <QOpenGLTexture>
+#include <QScopedArrayPointer>
+#include <QOpenGLFunctions_4_4_Core>
+
+struct AVFrame;
+struct VideoTextureFormat;
+
+class QOpenGLShaderProgram;
+
+/**
+ * @brief Textures of the current video frame and subtitle sampled by fragment.fsh,
+ *        shared by VideoRenderer and VideoNode. The frames are handed over on the GUI thread,
+ *        taken in synchronize() and uploaded in upload() on the render thread.
+ * @note Construct and use it on the render thread with the OpenGL context current
+ */
+class VideoTexture : protected QOpenGLFunctions_4_4_Core
+{
+public:
+    VideoTexture();
+    ~VideoTexture();
+
+    void updateVideoFrame(AVFrame *frame);
+    void updateSubtitleFrame(SubtitleFrame *frame);
+
+    /**
+     * @brief The uploaded video frames are given back to the pool
+     */
+    void setFramePool(FramePool *pool) { m_framePool = pool; }
+
+    /**
+     * @brief Take the handed over frames, called while the GUI thread is blocked
+     * @return true if the textures are (re)allocated, the uniforms have to be set again
+     */
+    bool synchronize();
+
+    /**
+     * @brief Upload the video frame taken in synchronize() if any,
+     *        here rather than in synchronize() the GUI thread is not blocked
+     */
+    void upload();
+
+    /**
+     * @brief Bind the textures to the units of the samplers in fragment.fsh
+     */
+    void bind();
+    void release();
+
+    /**
+     * @brief Set the samplers and the pixel format dependent uniforms of fragment.fsh,
+     *        the program has to be bound
+     */
+    void setUniforms(QOpenGLShaderProgram *program) const;
+
+    bool isCreated() const { return m_textureAlloced; }
+    QSize videoSize() const { return m_videoSize; }
+
+    /**
+     * @return count of the video frames uploaded and the time spent on it in nanoseconds,
+     *         the CPU side only since the transfer is asynchronous. Thread safe.
+     */
+    int uploadedFrames() const { return m_uploadedFrames.loadRelaxed(); }
+    qint64 uploadTime() const { return m_uploadTime.loadRelaxed(); }
+
+private:
+    QOpenGLTexture *m_texture[4] = { nullptr };    // [0]: Y, [1]: U, [2]: V, [3]: Subtitle
+
+    QSize m_videoSize;
+    const VideoTextureFormat *m_textureFormat = nullptr;
+
+    QMatrix3x3 m_colorConversion;
+    QVector3D m_colorOffset;
+
+    quint8 m_flags = 0;
+
+    AVFrame *m_frame = nullptr;
+    AVFrame *m_uploadFrame = nullptr;       // Handed over in synchronize(), uploaded in upload()
+    FramePool *m_framePool = nullptr;
+    SubtitleFrame *m_subtitle = nullptr;
+    QScopedArrayPointer<const GLubyte> m_dummySubtitle;
+
+    bool m_textureAlloced = false;
+
+    QAtomicInt m_uploadedFrames;
+    QAtomicInteger<qint64> m_uploadTime{0};
+
+    /**
+     * @brief Persistently mapped pixel unpack buffer, the texture upload
+     *        from it is asynchronous
+     */
+    struct PixelBuffer
+    {
+        GLuint id = 0;
+        void *data = nullptr;
+        GLsync fence = nullptr;     // Signaled when the GPU has finished reading
+    };
+
+    static constexpr int PixelBufferCount = 3;
+
+    PixelBuffer m_pixelBuffers[PixelBufferCount];
+    GLsizeiptr m_pixelBufferSize = 0;
+    int m_pixelBufferIndex = 0;
+    bool m_isPixelBufferFailed = false;     // Uploaded synchronously since the mapping failed
+
+    /**
+     * @return false if the frame was skipped, its pixel buffer is still read by the GPU
+     */
+    bool updateVideoTextureData();
+    void updateSubtitleTextureData();
+
+    void recycleFrame(AVFrame *&frame);
+
+    bool allocatePixelBuffers(GLsizeiptr size);
+    void destroyPixelBuffers();
+
+    void setupTexture();
+    void allocateTexture(const QSize sizes[3]);
+    void updateSubtitleTexture(const QSize &size);
+
+    void destoryTexture();
+};
+
+#endif // VIDEOTEXTURE_H